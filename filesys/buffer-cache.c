@@ -0,0 +1,396 @@
+/* buffer-cache.c: Cache of file system disk sectors. */
+
+#include "filesys/buffer-cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of sectors kept in the cache. */
+#define CACHE_SIZE 64
+
+/* Dirty sectors are written behind every FLUSH_INTERVAL ticks. */
+#define FLUSH_INTERVAL (30 * TIMER_FREQ)
+
+/* Most sectors waiting to be read ahead. */
+#define RA_QUEUE_SIZE 32
+
+/* A cache entry, holding one sector. */
+struct cache_entry {
+	disk_sector_t sector;               /* Sector held, if IN_USE. */
+	bool in_use;                        /* Holds a sector at all? */
+	bool accessed;                      /* Used since the clock passed? */
+	int pins;                           /* Users; pinned entries stay. */
+
+	struct lock lock;                   /* Guards the members below. */
+	bool valid;                         /* DATA read or written yet? */
+	bool dirty;                         /* DATA newer than the disk? */
+	bool meta;                          /* File system metadata? */
+	bool logged;                        /* Dirty DATA in the journal? */
+	uint8_t data[DISK_SECTOR_SIZE];
+};
+
+/* Returns true if E holds metadata changed since the last commit, which
+ * must not reach its home sector before the journal has it. */
+static inline bool
+held_back (const struct cache_entry *e) {
+	return e->meta && e->dirty && !e->logged;
+}
+
+static struct cache_entry cache[CACHE_SIZE];
+
+/* Guards SECTOR, IN_USE, ACCESSED and PINS of the entries, the clock hand,
+ * the read-ahead queue and the statistics. An entry's lock may be acquired
+ * while holding CACHE_LOCK, but not the other way around. */
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Sectors for the read-ahead worker, which waits on RA_COND. */
+static disk_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head, ra_tail;
+static struct condition ra_cond;
+
+/* Statistics. */
+static long long hit_cnt;               /* Sectors found in the cache. */
+static long long miss_cnt;              /* Sectors brought in on demand. */
+static long long ra_cnt;                /* Sectors read ahead. */
+
+static void flusher (void *aux);
+static void read_ahead_worker (void *aux);
+
+/* Initializes the buffer cache and starts writing behind. */
+void
+buffer_cache_init (void) {
+	size_t i;
+
+	lock_init (&cache_lock);
+	cond_init (&ra_cond);
+	for (i = 0; i < CACHE_SIZE; i++)
+		lock_init (&cache[i].lock);
+	thread_create ("flusher", PRI_DEFAULT, flusher, NULL);
+	thread_create ("read-ahead", PRI_DEFAULT, read_ahead_worker, NULL);
+}
+
+/* Writes every dirty sector to disk before shutting down. */
+void
+buffer_cache_done (void) {
+	buffer_cache_flush ();
+}
+
+/* Returns the entry holding SECTOR, or a null pointer. */
+static struct cache_entry *
+cache_lookup (disk_sector_t sector) {
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (i = 0; i < CACHE_SIZE; i++)
+		if (cache[i].in_use && cache[i].sector == sector)
+			return &cache[i];
+	return NULL;
+}
+
+/* Chooses an entry to reuse by the clock algorithm. A dirty entry is
+ * written back first, pinned and without CACHE_LOCK, so that the cache
+ * can be used meanwhile, and then looked at again when the hand comes
+ * back to it. Nobody uses an unpinned entry, so its state is safe to
+ * read under CACHE_LOCK alone. */
+static struct cache_entry *
+cache_evict (void) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (;;) {
+		size_t i;
+
+		for (i = 0; i < 2 * CACHE_SIZE; i++) {
+			struct cache_entry *e = &cache[clock_hand];
+
+			clock_hand = (clock_hand + 1) % CACHE_SIZE;
+			if (!e->in_use)
+				return e;
+			if (e->pins > 0 || held_back (e))
+				continue;
+			if (e->accessed) {
+				e->accessed = false;
+				continue;
+			}
+			if (e->dirty) {
+				e->pins++;
+				lock_release (&cache_lock);
+				lock_acquire (&e->lock);
+				if (e->dirty && !held_back (e)) {
+					disk_write (filesys_disk, e->sector, e->data);
+					e->dirty = false;
+				}
+				lock_release (&e->lock);
+				lock_acquire (&cache_lock);
+				e->pins--;
+				continue;
+			}
+			return e;
+		}
+
+		/* Every entry is in use or waits for a commit: let someone
+		 * finish. */
+		lock_release (&cache_lock);
+		thread_yield ();
+		lock_acquire (&cache_lock);
+	}
+}
+
+/* Gives SECTOR an entry, which is returned pinned and locked but not
+ * filled yet. Releases CACHE_LOCK. Returns a null pointer instead, with
+ * CACHE_LOCK still held, if someone else brought SECTOR in while an
+ * entry was written back. */
+static struct cache_entry *
+cache_install (disk_sector_t sector, bool accessed) {
+	struct cache_entry *e = cache_evict ();
+
+	if (cache_lookup (sector) != NULL)
+		return NULL;
+
+	e->sector = sector;
+	e->in_use = true;
+	e->accessed = accessed;
+	e->pins = 1;
+	e->valid = false;
+	e->meta = false;
+	e->logged = false;
+	/* Anyone else asking for SECTOR waits for it to be filled. */
+	lock_acquire (&e->lock);
+	lock_release (&cache_lock);
+	return e;
+}
+
+/* Returns the pinned and locked entry for SECTOR, bringing it into the
+ * cache if needed. Its data is read from disk if LOAD is true; otherwise
+ * the caller is about to overwrite all of it. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool load) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	for (;;) {
+		e = cache_lookup (sector);
+		if (e != NULL) {
+			hit_cnt++;
+			e->pins++;
+			e->accessed = true;
+			lock_release (&cache_lock);
+			lock_acquire (&e->lock);
+			break;
+		}
+		e = cache_install (sector, true);
+		if (e != NULL) {
+			miss_cnt++;
+			break;
+		}
+	}
+
+	if (!e->valid && load) {
+		disk_read (filesys_disk, sector, e->data);
+		e->valid = true;
+	}
+	return e;
+}
+
+/* Unlocks and unpins entry E, gotten from cache_get(). */
+static void
+cache_put (struct cache_entry *e) {
+	lock_release (&e->lock);
+	lock_acquire (&cache_lock);
+	e->pins--;
+	lock_release (&cache_lock);
+}
+
+/* Reads SIZE bytes at offset OFS in SECTOR into BUFFER. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, int ofs, int size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, true);
+	memcpy (buffer, e->data + ofs, size);
+	cache_put (e);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS in SECTOR, holding
+ * metadata if META is true. */
+static void
+cache_write (disk_sector_t sector, const void *buffer, int ofs, int size,
+		bool meta) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, size < DISK_SECTOR_SIZE);
+	memcpy (e->data + ofs, buffer, size);
+	e->valid = true;
+	e->dirty = true;
+	e->meta = meta;
+	e->logged = false;
+	cache_put (e);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS in SECTOR. The sector
+ * reaches the disk later, when it is evicted or flushed. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer, int ofs,
+		int size) {
+	cache_write (sector, buffer, ofs, size, false);
+}
+
+/* Writes SIZE bytes of metadata from BUFFER at offset OFS in SECTOR.
+ * The sector stays in the cache until the journal commits it. */
+void
+buffer_cache_write_meta (disk_sector_t sector, const void *buffer, int ofs,
+		int size) {
+	cache_write (sector, buffer, ofs, size, true);
+}
+
+/* Returns about how many metadata sectors wait for a commit. */
+size_t
+buffer_cache_unlogged (void) {
+	size_t cnt = 0, i;
+
+	lock_acquire (&cache_lock);
+	for (i = 0; i < CACHE_SIZE; i++)
+		if (cache[i].in_use && held_back (&cache[i]))
+			cnt++;
+	lock_release (&cache_lock);
+	return cnt;
+}
+
+/* Copies up to MAX metadata sectors waiting for a commit into BUFFER, one
+ * after another, and their sector numbers into SECTORS.
+ * Returns the number copied.  They keep waiting until passed to
+ * buffer_cache_logged(). */
+size_t
+buffer_cache_log (disk_sector_t *sectors, void *buffer, size_t max) {
+	size_t cnt = 0, i;
+
+	for (i = 0; i < CACHE_SIZE && cnt < max; i++) {
+		struct cache_entry *e = &cache[i];
+
+		lock_acquire (&cache_lock);
+		if (!e->in_use) {
+			lock_release (&cache_lock);
+			continue;
+		}
+		e->pins++;
+		lock_release (&cache_lock);
+
+		lock_acquire (&e->lock);
+		if (e->valid && held_back (e)) {
+			sectors[cnt] = e->sector;
+			memcpy ((uint8_t *) buffer + cnt * DISK_SECTOR_SIZE, e->data,
+					DISK_SECTOR_SIZE);
+			cnt++;
+		}
+		cache_put (e);
+	}
+	return cnt;
+}
+
+/* Marks the CNT metadata SECTORS as committed, so that they may be
+ * written home. */
+void
+buffer_cache_logged (const disk_sector_t *sectors, size_t cnt) {
+	size_t i;
+
+	lock_acquire (&cache_lock);
+	for (i = 0; i < cnt; i++) {
+		struct cache_entry *e = cache_lookup (sectors[i]);
+		if (e != NULL && e->meta)
+			e->logged = true;
+	}
+	lock_release (&cache_lock);
+}
+
+/* Asks for SECTOR to be read into the cache in the background. The request
+ * is dropped if too many are waiting already. */
+void
+buffer_cache_read_ahead (disk_sector_t sector) {
+	lock_acquire (&cache_lock);
+	if (ra_head - ra_tail < RA_QUEUE_SIZE && cache_lookup (sector) == NULL) {
+		ra_queue[ra_head++ % RA_QUEUE_SIZE] = sector;
+		cond_signal (&ra_cond, &cache_lock);
+	}
+	lock_release (&cache_lock);
+}
+
+/* Reads the sectors asked for by buffer_cache_read_ahead(). A sector read
+ * ahead is not marked accessed, so it is the first to go if nobody reads
+ * it. */
+static void
+read_ahead_worker (void *aux UNUSED) {
+	lock_acquire (&cache_lock);
+	for (;;) {
+		disk_sector_t sector;
+
+		while (ra_head == ra_tail)
+			cond_wait (&ra_cond, &cache_lock);
+		sector = ra_queue[ra_tail++ % RA_QUEUE_SIZE];
+		if (cache_lookup (sector) == NULL) {
+			struct cache_entry *e = cache_install (sector, false);
+
+			if (e == NULL)
+				continue;
+			disk_read (filesys_disk, sector, e->data);
+			e->valid = true;
+			cache_put (e);
+			lock_acquire (&cache_lock);
+			ra_cnt++;
+		}
+	}
+}
+
+/* Writes every dirty sector in the cache to disk, except metadata still
+ * waiting for a commit. */
+void
+buffer_cache_flush (void) {
+	size_t i;
+
+	for (i = 0; i < CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[i];
+
+		lock_acquire (&cache_lock);
+		if (!e->in_use) {
+			lock_release (&cache_lock);
+			continue;
+		}
+		e->pins++;
+		lock_release (&cache_lock);
+
+		lock_acquire (&e->lock);
+		if (e->valid && e->dirty && !held_back (e)) {
+			disk_write (filesys_disk, e->sector, e->data);
+			e->dirty = false;
+		}
+		cache_put (e);
+	}
+}
+
+/* Writes dirty sectors behind every FLUSH_INTERVAL ticks, so that a crash
+ * loses little. */
+static void
+flusher (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (FLUSH_INTERVAL);
+		buffer_cache_flush ();
+	}
+}
+
+/* Prints buffer cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	long long total = hit_cnt + miss_cnt;
+
+	printf ("Buffer cache: %lld hits, %lld misses (%lld%% hit rate), "
+			"%lld read ahead\n",
+			hit_cnt, miss_cnt, total > 0 ? hit_cnt * 100 / total : 0, ra_cnt);
+}
@@ -0,0 +1,160 @@
+/* dcache.c: Cache of directory lookups. */
+
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Most lookups kept in the cache. */
+#define DCACHE_SIZE 64
+
+/* The result of looking up NAME in the directory at sector DIR.
+ * A negative entry records that no such file exists. */
+struct dentry {
+	struct hash_elem hash_elem;         /* Element in DENTRIES. */
+	struct list_elem lru_elem;          /* Element in LRU. */
+	disk_sector_t dir;                  /* Directory's inode sector. */
+	char name[NAME_MAX + 1];            /* Null terminated file name. */
+	bool exists;                        /* False for a negative entry. */
+	disk_sector_t sector;               /* File's inode sector, if EXISTS. */
+};
+
+/* Entries by (DIR, NAME), and in LRU from least to most recently used.
+ * Both are guarded by DCACHE_LOCK. */
+static struct hash dentries;
+static struct list lru;
+static struct lock dcache_lock;
+
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+	return hash_int (d->dir) ^ hash_string (d->name);
+}
+
+static bool
+dentry_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	const struct dentry *da = hash_entry (a, struct dentry, hash_elem);
+	const struct dentry *db = hash_entry (b, struct dentry, hash_elem);
+	if (da->dir != db->dir)
+		return da->dir < db->dir;
+	return strcmp (da->name, db->name) < 0;
+}
+
+/* Initializes the directory lookup cache. */
+void
+dcache_init (void) {
+	hash_init (&dentries, dentry_hash, dentry_less, NULL);
+	list_init (&lru);
+	lock_init (&dcache_lock);
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer. */
+static struct dentry *
+dentry_find (disk_sector_t dir, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&dcache_lock));
+
+	key.dir = dir;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dentries, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Drops entry D. */
+static void
+dentry_free (struct dentry *d) {
+	hash_delete (&dentries, &d->hash_elem);
+	list_remove (&d->lru_elem);
+	free (d);
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+ * On a hit, returns true and sets *EXISTSP to whether such a file
+ * exists and, if it does, *SECTORP to its inode sector.
+ * Returns false if the cache does not know. */
+bool
+dcache_lookup (disk_sector_t dir, const char *name,
+		bool *existsp, disk_sector_t *sectorp) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return false;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL) {
+		list_remove (&d->lru_elem);
+		list_push_back (&lru, &d->lru_elem);
+		*existsp = d->exists;
+		if (d->exists)
+			*sectorp = d->sector;
+	}
+	lock_release (&dcache_lock);
+	return d != NULL;
+}
+
+/* Records that NAME in the directory at sector DIR is the file whose
+ * inode is in SECTOR if EXISTS, or that there is no such file. */
+void
+dcache_insert (disk_sector_t dir, const char *name,
+		bool exists, disk_sector_t sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL)
+		list_remove (&d->lru_elem);
+	else {
+		if (hash_size (&dentries) >= DCACHE_SIZE)
+			dentry_free (list_entry (list_front (&lru), struct dentry,
+						lru_elem));
+		d = malloc (sizeof *d);
+		if (d == NULL) {
+			lock_release (&dcache_lock);
+			return;
+		}
+		d->dir = dir;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dentries, &d->hash_elem);
+	}
+	d->exists = exists;
+	d->sector = sector;
+	list_push_back (&lru, &d->lru_elem);
+	lock_release (&dcache_lock);
+}
+
+/* Forgets every lookup in the directory at sector DIR, for a new
+ * directory that reuses the sector. */
+void
+dcache_purge (disk_sector_t dir) {
+	struct list_elem *e;
+
+	lock_acquire (&dcache_lock);
+	for (e = list_begin (&lru); e != list_end (&lru);) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+
+		e = list_next (e);
+		if (d->dir == dir)
+			dentry_free (d);
+	}
+	lock_release (&dcache_lock);
+}
+
+/* Forgets every lookup, as when the file system goes away. */
+void
+dcache_clear (void) {
+	lock_acquire (&dcache_lock);
+	while (!list_empty (&lru))
+		dentry_free (list_entry (list_front (&lru), struct dentry, lru_elem));
+	lock_release (&dcache_lock);
+}
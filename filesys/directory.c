@@ -1,15 +1,29 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
-/* A directory. */
+/* A directory.
+ * Its entries are hashed by name into the number of buckets recorded in
+ * its first block.  Bucket I starts with the sector-sized block at offset
+ * BASE + I * DISK_SECTOR_SIZE, BASE also being recorded in the first
+ * block.  When a bucket fills up, overflow blocks are appended to the end
+ * of the directory and chained from the bucket's last block.  Once there
+ * are as many overflow blocks as buckets, the buckets double and every
+ * entry is hashed again into new blocks at the end of the directory,
+ * which the first block then points to.  Blocks only count if a bucket
+ * reaches them, so the directory is read by following the chains. */
 struct dir {
 	struct inode *inode;                /* Backing store. */
-	off_t pos;                          /* Current position. */
+	size_t bucket;                      /* Current position: bucket, */
+	size_t pos;                         /* and entry in its chain. */
 };
 
 /* A single directory entry. */
@@ -19,11 +33,124 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* Header of each block of a directory.  All but NEXT are only used in
+ * the first block. */
+struct dir_header {
+	off_t next;                         /* Next block of the bucket,
+	                                       0 if none. */
+	uint32_t bucket_cnt;                /* Number of buckets. */
+	off_t base;                         /* Offset of the first bucket. */
+	uint32_t overflow_cnt;              /* Overflow blocks in the chains. */
+};
+
+/* Entries in a block, which follow its header. */
+#define BLOCK_ENTRIES ((DISK_SECTOR_SIZE - sizeof (struct dir_header)) \
+		/ sizeof (struct dir_entry))
+
+/* A block of a directory. */
+struct dir_block {
+	struct dir_header header;
+	struct dir_entry entries[BLOCK_ENTRIES];
+};
+
+/* Buckets of the smallest directory. */
+#define MIN_BUCKETS 8
+
+/* Returns the offset of entry SLOT in the block at BLOCK. */
+static inline off_t
+entry_ofs (off_t block, size_t slot) {
+	return block + sizeof (struct dir_header)
+		+ slot * sizeof (struct dir_entry);
+}
+
+/* Gets the header of the first block of DIR into *HEADER, except for
+ * NEXT.  A copy is kept with the inode rather than in DIR, because
+ * adding an entry through another `struct dir' may change it.
+ * Returns false if it cannot be read. */
+static bool
+read_header (const struct dir *dir, struct dir_header *header) {
+	struct dir_header *copy = inode_get_aux (dir->inode);
+
+	if (copy != NULL) {
+		*header = *copy;
+		return true;
+	}
+	if (inode_read_at (dir->inode, header, sizeof *header, 0)
+			!= sizeof *header || header->bucket_cnt == 0)
+		return false;
+	copy = malloc (sizeof *copy);
+	if (copy != NULL) {
+		*copy = *header;
+		inode_set_aux (dir->inode, copy);
+	}
+	return true;
+}
+
+/* Writes HEADER as the header of the first block of DIR, except for
+ * NEXT, which belongs to the first bucket if the buckets start there.
+ * Returns true if successful. */
+static bool
+write_header (struct dir *dir, const struct dir_header *header) {
+	const off_t ofs = offsetof (struct dir_header, bucket_cnt);
+	struct dir_header *copy = inode_get_aux (dir->inode);
+
+	if (inode_write_at (dir->inode, (const uint8_t *) header + ofs,
+				sizeof *header - ofs, ofs) != (off_t) sizeof *header - ofs)
+		return false;
+	if (copy != NULL)
+		*copy = *header;
+	return true;
+}
+
+/* Returns the offset of the first block of bucket B, as laid out by
+ * HEADER. */
+static inline off_t
+bucket_ofs (const struct dir_header *header, size_t b) {
+	return header->base + b * DISK_SECTOR_SIZE;
+}
+
+/* Returns the offset of the block after the one at BLOCK in its bucket,
+ * or 0 if there is none. */
+static off_t
+next_block (const struct dir *dir, off_t block) {
+	struct dir_header header;
+
+	if (inode_read_at (dir->inode, &header, sizeof header, block)
+			!= sizeof header)
+		return 0;
+	return header.next;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) {
-	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+	struct dir_header header = {
+		.bucket_cnt = DIV_ROUND_UP (entry_cnt, BLOCK_ENTRIES),
+	};
+	off_t length;
+	struct inode *inode;
+	bool success;
+
+	if (header.bucket_cnt < MIN_BUCKETS)
+		header.bucket_cnt = MIN_BUCKETS;
+	length = header.bucket_cnt * DISK_SECTOR_SIZE;
+
+	/* Grow the directory by writing its last byte, so that the buckets
+	 * are zeroed through the journal like the rest of it. */
+	if (!inode_create (sector, 0))
+		return false;
+	dcache_purge (sector);
+	inode = inode_open (sector);
+	if (inode == NULL)
+		return false;
+	inode_set_metadata (inode);
+	journal_begin ();
+	success = inode_write_at (inode, "", 1, length - 1) == 1
+		&& inode_write_at (inode, &header, sizeof header, 0) == sizeof header;
+	journal_end ();
+	inode_close (inode);
+	return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -31,9 +158,14 @@ dir_create (disk_sector_t sector, size_t entry_cnt) {
 struct dir *
 dir_open (struct inode *inode) {
 	struct dir *dir = calloc (1, sizeof *dir);
+	struct dir_header header;
+
 	if (inode != NULL && dir != NULL) {
 		dir->inode = inode;
-		dir->pos = 0;
+		dir->bucket = dir->pos = 0;
+	}
+	if (dir != NULL && dir->inode != NULL && read_header (dir, &header)) {
+		inode_set_metadata (inode);
 		return dir;
 	} else {
 		inode_close (inode);
@@ -71,60 +203,248 @@ dir_get_inode (struct dir *dir) {
 	return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
+/* Searches DIR for a file with the given NAME, reading only the blocks
+ * of the bucket NAME hashes to.
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
  * directory entry if OFSP is non-null.
- * otherwise, returns false and ignores EP and OFSP. */
+ * otherwise, returns false and ignores EP and OFSP.
+ * Either way, if FREEP is non-null, sets it to the offset of the first
+ * free entry in the bucket, or to the negated offset of the bucket's
+ * last block, minus 1, if the bucket is full. */
 static bool
 lookup (const struct dir *dir, const char *name,
-		struct dir_entry *ep, off_t *ofsp) {
+		struct dir_entry *ep, off_t *ofsp, off_t *freep) {
+	struct dir_header header;
 	struct dir_entry e;
-	size_t ofs;
+	off_t block, free_ofs = -1;
+	bool found = false;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (e.in_use && !strcmp (name, e.name)) {
-			if (ep != NULL)
-				*ep = e;
-			if (ofsp != NULL)
-				*ofsp = ofs;
-			return true;
+	if (!read_header (dir, &header))
+		return false;
+	block = bucket_ofs (&header, hash_string (name) % header.bucket_cnt);
+	for (;;) {
+		off_t next;
+		size_t slot;
+
+		/* A block at the end of the directory may be short, with its
+		 * missing slots free. */
+		for (slot = 0; slot < BLOCK_ENTRIES; slot++) {
+			off_t ofs = entry_ofs (block, slot);
+
+			if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e) {
+				if (free_ofs < 0)
+					free_ofs = ofs;
+				break;
+			}
+			if (!e.in_use) {
+				if (free_ofs < 0)
+					free_ofs = ofs;
+			} else if (!strcmp (name, e.name)) {
+				if (ep != NULL)
+					*ep = e;
+				if (ofsp != NULL)
+					*ofsp = ofs;
+				found = true;
+				goto done;
+			}
 		}
-	return false;
+		next = next_block (dir, block);
+		if (next == 0)
+			break;
+		block = next;
+	}
+
+done:
+	if (freep != NULL)
+		*freep = free_ofs >= 0 ? free_ofs : -block - 1;
+	return found;
 }
 
 /* Searches DIR for a file with the given NAME
  * and returns true if one exists, false otherwise.
  * On success, sets *INODE to an inode for the file, otherwise to
- * a null pointer.  The caller must close *INODE. */
+ * a null pointer.  The caller must close *INODE.
+ * Repeated lookups are answered from the dcache without reading DIR. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t dir_sector;
 	struct dir_entry e;
+	bool exists;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
-	else
-		*inode = NULL;
+	dir_sector = inode_get_inumber (dir->inode);
+	if (!dcache_lookup (dir_sector, name, &exists, &e.inode_sector)) {
+		exists = lookup (dir, name, &e, NULL, NULL);
+		dcache_insert (dir_sector, name, exists, e.inode_sector);
+	}
+	*inode = exists ? inode_open (e.inode_sector) : NULL;
 
 	return *inode != NULL;
 }
 
+/* Returns the offset of entry IDX in the chain of bucket B of DIR, laid
+ * out by HEADER, or -1 if the chain is shorter. */
+static off_t
+chain_entry (const struct dir *dir, const struct dir_header *header,
+		size_t b, size_t idx) {
+	off_t block = bucket_ofs (header, b);
+
+	for (; idx >= BLOCK_ENTRIES; idx -= BLOCK_ENTRIES)
+		if ((block = next_block (dir, block)) == 0)
+			return -1;
+	return entry_ofs (block, idx);
+}
+
+/* Writes entry E, whose name is not in DIR, into the free slot FREE_OFS
+ * that lookup () found for it.  Returns true if successful. */
+static bool
+insert (struct dir *dir, const struct dir_entry *e, off_t free_ofs) {
+	off_t tail = -free_ofs - 1;
+	off_t block = ROUND_UP (inode_length (dir->inode), DISK_SECTOR_SIZE);
+	struct dir_header header;
+
+	if (free_ofs >= 0)
+		return inode_write_at (dir->inode, e, sizeof *e, free_ofs)
+			== sizeof *e;
+
+	/* The bucket is full: fill the first slot of a new block at the end
+	 * of the directory, then chain it after the bucket's last. */
+	if (!read_header (dir, &header))
+		return false;
+	header.overflow_cnt++;
+	return inode_write_at (dir->inode, e, sizeof *e,
+				entry_ofs (block, 0)) == sizeof *e
+		&& inode_write_at (dir->inode, &block, sizeof block,
+				tail + offsetof (struct dir_header, next)) == sizeof block
+		&& write_header (dir, &header);
+}
+
+/* Hashes the entries of DIR into NEW_CNT buckets, which must be more
+ * than it has.  The new buckets, and the overflow blocks the entries
+ * need, are laid out past the end of the directory, and only once every
+ * entry is in place does the first block point to them.  Until then the
+ * old buckets stay as they are, so a failure loses no entry.  The old
+ * blocks are not used again.
+ * Nothing reaches the new blocks before the switch, so they are written
+ * in journal operations of their own, a block each, which keeps each
+ * operation small however large DIR is.
+ * Returns true if successful, false if out of memory or disk space. */
+static bool
+rehash (struct dir *dir, size_t new_cnt) {
+	struct dir_header header;
+	struct dir_entry *entries = NULL, *sorted = NULL;
+	struct dir_block *block = NULL;
+	size_t *first = NULL;
+	size_t entry_cnt = 0, overflow_cnt = 0, b;
+	off_t base, overflow;
+	bool success = false;
+
+	if (!read_header (dir, &header))
+		return false;
+	entries = malloc ((header.bucket_cnt + header.overflow_cnt)
+			* BLOCK_ENTRIES * sizeof *entries);
+	sorted = malloc ((header.bucket_cnt + header.overflow_cnt)
+			* BLOCK_ENTRIES * sizeof *sorted);
+	first = calloc (new_cnt + 1, sizeof *first);
+	block = malloc (sizeof *block);
+	if (entries == NULL || sorted == NULL || first == NULL || block == NULL)
+		goto done;
+
+	/* Gather the entries in use, counting them by new bucket. */
+	for (b = 0; b < header.bucket_cnt; b++) {
+		size_t idx;
+
+		for (idx = 0; ; idx++) {
+			struct dir_entry *e = &entries[entry_cnt];
+			off_t ofs = chain_entry (dir, &header, b, idx);
+
+			if (ofs < 0
+					|| inode_read_at (dir->inode, e, sizeof *e, ofs) != sizeof *e)
+				break;
+			if (e->in_use) {
+				first[hash_string (e->name) % new_cnt]++;
+				entry_cnt++;
+			}
+		}
+	}
+
+	/* Sort them by new bucket, those of bucket B going from FIRST[B] up
+	 * to FIRST[B + 1]. */
+	for (b = 0; b < new_cnt; b++) {
+		if (first[b] > BLOCK_ENTRIES)
+			overflow_cnt += DIV_ROUND_UP (first[b], BLOCK_ENTRIES) - 1;
+		if (b > 0)
+			first[b] += first[b - 1];
+	}
+	first[new_cnt] = entry_cnt;
+	for (size_t i = entry_cnt; i-- > 0; )
+		sorted[--first[hash_string (entries[i].name) % new_cnt]] = entries[i];
+
+	/* Give the new blocks disk space, then fill them. */
+	base = ROUND_UP (inode_length (dir->inode), DISK_SECTOR_SIZE);
+	overflow = base + new_cnt * DISK_SECTOR_SIZE;
+	if (inode_write_at (dir->inode, "", 1,
+				overflow + overflow_cnt * DISK_SECTOR_SIZE - 1) != 1)
+		goto done;
+	for (b = 0; b < new_cnt; b++) {
+		off_t ofs = base + b * DISK_SECTOR_SIZE;
+		size_t i = first[b];
+
+		do {
+			size_t cnt = first[b + 1] - i;
+
+			if (cnt > BLOCK_ENTRIES)
+				cnt = BLOCK_ENTRIES;
+			memset (block, 0, sizeof *block);
+			memcpy (block->entries, sorted + i, cnt * sizeof *sorted);
+			i += cnt;
+			if (i < first[b + 1]) {
+				block->header.next = overflow;
+				overflow += DISK_SECTOR_SIZE;
+			}
+			journal_begin ();
+			success = inode_write_at (dir->inode, block, sizeof *block, ofs)
+				== sizeof *block;
+			journal_end ();
+			if (!success)
+				goto done;
+			ofs = block->header.next;
+		} while (i < first[b + 1]);
+	}
+
+	/* Switch to the new buckets. */
+	header.bucket_cnt = new_cnt;
+	header.base = base;
+	header.overflow_cnt = overflow_cnt;
+	journal_begin ();
+	success = write_header (dir, &header);
+	journal_end ();
+
+done:
+	free (entries);
+	free (sorted);
+	free (first);
+	free (block);
+	return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
  * file by that name.  The file's inode is in sector
- * INODE_SECTOR.
+ * INODE_SECTOR.  A rehash takes journal operations of its own, so this
+ * should not be called within one.
  * Returns true if successful, false on failure.
  * Fails if NAME is invalid (i.e. too long) or a disk or memory
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	struct dir_header header;
 	struct dir_entry e;
 	off_t ofs;
 	bool success = false;
@@ -136,27 +456,28 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
-	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
+	/* Check that NAME is not in use, noting a free slot in its bucket on
+	 * the way. */
+	if (!read_header (dir, &header) || lookup (dir, name, NULL, NULL, &ofs))
 		goto done;
 
-	/* Set OFS to offset of free slot.
-	 * If there are no free slots, then it will be set to the
-	 * current end-of-file.
-
-	 * inode_read_at() will only return a short read at end of file.
-	 * Otherwise, we'd need to verify that we didn't get a short
-	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (!e.in_use)
-			break;
-
 	/* Write slot. */
 	e.in_use = true;
 	strlcpy (e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
-	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+
+	/* The bucket is full.  Double the buckets instead of chaining another
+	 * block if chains are two blocks long on average already.  If that
+	 * fails, the old buckets are still there to chain to. */
+	if (ofs < 0 && header.overflow_cnt >= header.bucket_cnt
+			&& rehash (dir, header.bucket_cnt * 2))
+		lookup (dir, name, NULL, NULL, &ofs);
+	journal_begin ();
+	success = insert (dir, &e, ofs);
+	journal_end ();
+	if (success)
+		dcache_insert (inode_get_inumber (dir->inode), name, true,
+				inode_sector);
 
 done:
 	return success;
@@ -176,7 +497,7 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (name != NULL);
 
 	/* Find directory entry. */
-	if (!lookup (dir, name, &e, &ofs))
+	if (!lookup (dir, name, &e, &ofs, NULL))
 		goto done;
 
 	/* Open inode. */
@@ -186,12 +507,16 @@ dir_remove (struct dir *dir, const char *name) {
 
 	/* Erase directory entry. */
 	e.in_use = false;
-	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+	journal_begin ();
+	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+	journal_end ();
+	if (!success)
 		goto done;
 
-	/* Remove inode. */
+	/* Remove inode, whose data is freed once it is closed, outside the
+	 * journal operation. */
 	inode_remove (inode);
-	success = true;
+	dcache_insert (inode_get_inumber (dir->inode), name, false, 0);
 
 done:
 	inode_close (inode);
@@ -203,10 +528,21 @@ done:
  * contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
+	struct dir_header header;
 	struct dir_entry e;
 
-	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
-		dir->pos += sizeof e;
+	if (!read_header (dir, &header))
+		return false;
+	while (dir->bucket < header.bucket_cnt) {
+		off_t ofs = chain_entry (dir, &header, dir->bucket, dir->pos);
+
+		if (ofs < 0
+				|| inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e) {
+			dir->bucket++;
+			dir->pos = 0;
+			continue;
+		}
+		dir->pos++;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
 			return true;
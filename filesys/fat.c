@@ -1,11 +1,16 @@
 #include "filesys/fat.h"
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#include <bitmap.h>
 #include <stdio.h>
 #include <string.h>
 
+/* FAT entries per sector of the FAT. */
+#define FAT_ENTRIES_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (cluster_t))
+
 /* Should be less than DISK_SECTOR_SIZE */
 struct fat_boot {
 	unsigned int magic;
@@ -22,14 +27,23 @@ struct fat_fs {
 	unsigned int *fat;
 	unsigned int fat_length;
 	disk_sector_t data_start;
-	cluster_t last_clst;
-	struct lock write_lock;
+	cluster_t last_clst;             /* Where to look for a free cluster. */
+	struct lock write_lock;          /* Serializes chain updates. */
+	struct bitmap *used_map;         /* Clusters in use, one bit each. */
+	struct bitmap *dirty_map;        /* FAT sectors newer than the disk. */
+	struct bitmap *log_map;          /* FAT sectors changed since the last
+	                                    commit to the journal. */
+	unsigned chain_gen;              /* Bumped whenever chains are cut. */
+	size_t free_cnt;                 /* Clusters free. */
+	size_t reserved_cnt;             /* Of those, clusters promised by
+	                                    fat_reserve(). */
 };
 
 static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_maps_init (void);
 
 void
 fat_init (void) {
@@ -78,6 +92,8 @@ fat_open (void) {
 			free (bounce);
 		}
 	}
+
+	fat_maps_init ();
 }
 
 void
@@ -90,13 +106,27 @@ fat_close (void) {
 	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
+	fat_flush ();
+}
+
+/* Writes the sectors of the FAT newer than the disk directly to the disk,
+ * except those the journal does not have yet. */
+void
+fat_flush (void) {
+	uint8_t *bounce;
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_wrote = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_wrote;
+		if (!bitmap_test (fat_fs->dirty_map, i)
+				|| bitmap_test (fat_fs->log_map, i)) {
+			bytes_wrote += bytes_left < DISK_SECTOR_SIZE
+				? bytes_left : DISK_SECTOR_SIZE;
+			continue;
+		}
+		bitmap_reset (fat_fs->dirty_map, i);
 		if (bytes_left >= DISK_SECTOR_SIZE) {
 			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
 			            buffer + bytes_wrote);
@@ -104,7 +134,7 @@ fat_close (void) {
 		} else {
 			bounce = calloc (1, DISK_SECTOR_SIZE);
 			if (bounce == NULL)
-				PANIC ("FAT close failed");
+				PANIC ("FAT flush failed");
 			memcpy (bounce, buffer + bytes_wrote, bytes_left);
 			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
 			bytes_wrote += bytes_left;
@@ -113,6 +143,49 @@ fat_close (void) {
 	}
 }
 
+/* Copies up to MAX sectors of the FAT changed since the last call into
+ * BUFFER, one after another, and their sector numbers into SECTORS, for
+ * the journal to commit.
+ * Returns the number copied. */
+size_t
+fat_log (disk_sector_t *sectors, void *buffer, size_t max) {
+	const size_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
+	size_t cnt = 0;
+	size_t i;
+
+	lock_acquire (&fat_fs->write_lock);
+	for (i = 0; i < fat_fs->bs.fat_sectors && cnt < max; i++) {
+		size_t ofs = i * DISK_SECTOR_SIZE;
+		size_t size = fat_size_in_bytes - ofs < DISK_SECTOR_SIZE
+			? fat_size_in_bytes - ofs : DISK_SECTOR_SIZE;
+		uint8_t *dst = (uint8_t *) buffer + cnt * DISK_SECTOR_SIZE;
+
+		if (!bitmap_test (fat_fs->log_map, i))
+			continue;
+		bitmap_reset (fat_fs->log_map, i);
+		memcpy (dst, (uint8_t *) fat_fs->fat + ofs, size);
+		memset (dst + size, 0, DISK_SECTOR_SIZE - size);
+		sectors[cnt++] = fat_fs->bs.fat_start + i;
+	}
+	lock_release (&fat_fs->write_lock);
+	return cnt;
+}
+
+/* Returns the number of sectors of the FAT changed since the last call
+ * to fat_log(). */
+size_t
+fat_unlogged (void) {
+	size_t cnt;
+
+	if (fat_fs == NULL || fat_fs->log_map == NULL)
+		return 0;
+	lock_acquire (&fat_fs->write_lock);
+	cnt = bitmap_count (fat_fs->log_map, 0, bitmap_size (fat_fs->log_map),
+			true);
+	lock_release (&fat_fs->write_lock);
+	return cnt;
+}
+
 void
 fat_create (void) {
 	// Create FAT boot
@@ -123,6 +196,10 @@ fat_create (void) {
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT creation failed");
+	fat_maps_init ();
+
+	// Whatever FAT the disk held before is stale
+	bitmap_set_all (fat_fs->dirty_map, true);
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
@@ -137,13 +214,15 @@ fat_create (void) {
 
 void
 fat_boot_create (void) {
+	/* The journal takes the end of the disk. */
+	unsigned int total_sectors = journal_start ();
 	unsigned int fat_sectors =
-	    (disk_size (filesys_disk) - 1)
+	    (total_sectors - 1)
 	    / (DISK_SECTOR_SIZE / sizeof (cluster_t) * SECTORS_PER_CLUSTER + 1) + 1;
 	fat_fs->bs = (struct fat_boot){
 	    .magic = FAT_MAGIC,
 	    .sectors_per_cluster = SECTORS_PER_CLUSTER,
-	    .total_sectors = disk_size (filesys_disk),
+	    .total_sectors = total_sectors,
 	    .fat_start = 1,
 	    .fat_sectors = fat_sectors,
 	    .root_dir_cluster = ROOT_DIR_CLUSTER,
@@ -152,42 +231,165 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	/* Cluster 0 is not a cluster: it marks free entries. */
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER + 1;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER + 1;
+	lock_init (&fat_fs->write_lock);
+}
+
+/* Builds the map of clusters in use from the FAT just loaded or created,
+ * and starts with no dirty FAT sectors. */
+static void
+fat_maps_init (void) {
+	if (fat_fs->used_map != NULL)
+		bitmap_destroy (fat_fs->used_map);
+	if (fat_fs->dirty_map != NULL)
+		bitmap_destroy (fat_fs->dirty_map);
+	if (fat_fs->log_map != NULL)
+		bitmap_destroy (fat_fs->log_map);
+
+	fat_fs->used_map = bitmap_create (fat_fs->fat_length);
+	fat_fs->dirty_map = bitmap_create (fat_fs->bs.fat_sectors);
+	fat_fs->log_map = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->used_map == NULL || fat_fs->dirty_map == NULL
+			|| fat_fs->log_map == NULL)
+		PANIC ("FAT maps creation failed");
+
+	bitmap_mark (fat_fs->used_map, 0);
+	for (cluster_t clst = 1; clst < fat_fs->fat_length; clst++)
+		if (fat_fs->fat[clst] != 0)
+			bitmap_mark (fat_fs->used_map, clst);
+	fat_fs->free_cnt = bitmap_count (fat_fs->used_map, 0,
+			fat_fs->fat_length, false);
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Returns a free cluster, or 0 if the disk is full. The cluster right
+ * after CLST is preferred, so that a chain grown one cluster at a time
+ * stays contiguous; otherwise the search carries on from where the last
+ * one stopped. */
+static cluster_t
+fat_find_free (cluster_t clst) {
+	size_t free;
+
+	if (clst != 0 && clst + 1 < fat_fs->fat_length
+			&& !bitmap_test (fat_fs->used_map, clst + 1))
+		return clst + 1;
+
+	free = bitmap_scan (fat_fs->used_map, fat_fs->last_clst, 1, false);
+	if (free == BITMAP_ERROR)
+		free = bitmap_scan (fat_fs->used_map, 1, 1, false);
+	return free != BITMAP_ERROR ? free : 0;
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
+ * Clusters promised by fat_reserve() are not taken.
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t new = 0;
+
+	lock_acquire (&fat_fs->write_lock);
+	if (fat_fs->free_cnt > fat_fs->reserved_cnt)
+		new = fat_find_free (clst);
+	if (new != 0) {
+		fat_put (new, clst != 0 ? fat_get (clst) : EOChain);
+		if (clst != 0)
+			fat_put (clst, new);
+		fat_fs->last_clst = new + 1 < fat_fs->fat_length ? new + 1 : 1;
+	}
+	lock_release (&fat_fs->write_lock);
+	return new;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	fat_fs->chain_gen++;
+	if (pclst != 0)
+		fat_put (pclst, EOChain);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_get (clst);
+		fat_put (clst, 0);
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
+}
+
+/* Promises CNT free clusters to later calls to fat_create_chain(), which
+ * only the caller may take, after giving them back with fat_unreserve().
+ * Returns false if fewer are free. */
+bool
+fat_reserve (size_t cnt) {
+	bool success;
+
+	lock_acquire (&fat_fs->write_lock);
+	success = fat_fs->free_cnt >= fat_fs->reserved_cnt + cnt;
+	if (success)
+		fat_fs->reserved_cnt += cnt;
+	lock_release (&fat_fs->write_lock);
+	return success;
+}
+
+/* Gives back CNT clusters promised by fat_reserve(). */
+void
+fat_unreserve (size_t cnt) {
+	lock_acquire (&fat_fs->write_lock);
+	ASSERT (cnt <= fat_fs->reserved_cnt);
+	fat_fs->reserved_cnt -= cnt;
+	lock_release (&fat_fs->write_lock);
+}
+
+/* Returns a number that changes whenever fat_remove_chain() cuts a chain,
+ * so that copies of chains can tell they may be stale. */
+unsigned
+fat_chain_generation (void) {
+	return fat_fs->chain_gen;
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+
+	if (fat_fs->fat[clst] == 0 && val != 0)
+		fat_fs->free_cnt--;
+	else if (fat_fs->fat[clst] != 0 && val == 0)
+		fat_fs->free_cnt++;
+	fat_fs->fat[clst] = val;
+	bitmap_set (fat_fs->used_map, clst, val != 0);
+	bitmap_mark (fat_fs->dirty_map, clst / FAT_ENTRIES_PER_SECTOR);
+	bitmap_mark (fat_fs->log_map, clst / FAT_ENTRIES_PER_SECTOR);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Converts the first sector of a cluster to the cluster #. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
 }
@@ -1,8 +1,13 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/disk.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Bounds of the read-ahead window, in bytes. */
+#define RA_MIN_WINDOW (4 * DISK_SECTOR_SIZE)
+#define RA_MAX_WINDOW (16 * DISK_SECTOR_SIZE)
+
 /* An open file. */
 // struct file {
 // 	struct inode *inode;        /* File's inode. */
@@ -67,6 +72,38 @@ file_get_inode (struct file *file) {
 	return file->inode;
 }
 
+/* Notes that BYTES_READ bytes of FILE were just read at OFS and reads
+ * ahead of a sequential reader. The window doubles with every read that
+ * carries on where the last one stopped, and closes on any other.
+ * Only file_read () calls this, so the read-ahead state is serialized
+ * like the file position is. */
+static void
+file_read_ahead (struct file *file, off_t ofs, off_t bytes_read) {
+	off_t end = ofs + bytes_read;
+	off_t start;
+
+	if (ofs == file->ra_next && bytes_read > 0) {
+		file->ra_window *= 2;
+		if (file->ra_window < RA_MIN_WINDOW)
+			file->ra_window = RA_MIN_WINDOW;
+		if (file->ra_window > RA_MAX_WINDOW)
+			file->ra_window = RA_MAX_WINDOW;
+	} else {
+		file->ra_window = 0;
+		file->ra_end = 0;
+	}
+	file->ra_next = end;
+	if (file->ra_window == 0)
+		return;
+
+	/* Only ask for what is not on its way yet. */
+	start = file->ra_end > end ? file->ra_end : end;
+	if (start < end + file->ra_window) {
+		inode_read_ahead (file->inode, end + file->ra_window - start, start);
+		file->ra_end = end + file->ra_window;
+	}
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
  * starting at the file's current position.
  * Returns the number of bytes actually read,
@@ -75,6 +112,7 @@ file_get_inode (struct file *file) {
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
 	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	file_read_ahead (file, file->pos, bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -83,7 +121,8 @@ file_read (struct file *file, void *buffer, off_t size) {
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually read,
  * which may be less than SIZE if end of file is reached.
- * The file's current position is unaffected. */
+ * The file's current position and read-ahead are unaffected: page faults
+ * read through here without filesys_lock, and do their own read-ahead. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
 	return inode_read_at (file->inode, buffer, size, file_ofs);
@@ -92,9 +131,8 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk is full.
+ * Writing past end of file grows the file.
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
@@ -106,9 +144,8 @@ file_write (struct file *file, const void *buffer, off_t size) {
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk is full.
+ * Writing past end of file grows the file.
  * The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
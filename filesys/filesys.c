@@ -2,9 +2,12 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/buffer-cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
 #include "devices/disk.h"
 
@@ -12,6 +15,7 @@
 struct disk *filesys_disk;
 
 static void do_format (void);
+static void report_fragmentation (void);
 
 /* Initializes the file system module.
  * If FORMAT is true, reformats the file system. */
@@ -21,7 +25,10 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+	buffer_cache_init ();
 	inode_init ();
+	dcache_init ();
+	journal_init (format);
 
 #ifdef EFILESYS
 	fat_init ();
@@ -39,34 +46,75 @@ filesys_init (bool format) {
 
 	free_map_open ();
 #endif
+
+	if (!format)
+		report_fragmentation ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
  * to disk. */
 void
 filesys_done (void) {
+	inode_done ();
+	report_fragmentation ();
+	journal_done ();
+
 	/* Original FS */
 #ifdef EFILESYS
 	fat_close ();
 #else
 	free_map_close ();
 #endif
+	dcache_clear ();
+	buffer_cache_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
  * Returns true if successful, false otherwise.
  * Fails if a file named NAME already exists,
- * or if internal memory allocation fails. */
+ * or if internal memory allocation fails.
+ * The inode is allocated and grown in journal operations of their own,
+ * and named last by dir_add(), so that a crash leaves either the whole
+ * file or an inode no directory reaches. */
 bool
 filesys_create (const char *name, off_t initial_size) {
 	disk_sector_t inode_sector = 0;
 	struct dir *dir = dir_open_root ();
-	bool success = (dir != NULL
-			&& free_map_allocate (1, &inode_sector)
-			&& inode_create (inode_sector, initial_size)
-			&& dir_add (dir, name, inode_sector));
-	if (!success && inode_sector != 0)
+	bool success;
+
+	journal_begin ();
+#ifdef EFILESYS
+	cluster_t inode_clst = fat_create_chain (0);
+	if (inode_clst != 0)
+		inode_sector = cluster_to_sector (inode_clst);
+#else
+	free_map_allocate (1, &inode_sector);
+#endif
+	journal_end ();
+
+	success = (dir != NULL
+			&& inode_sector != 0
+			&& inode_create (inode_sector, initial_size));
+	if (success && !dir_add (dir, name, inode_sector)) {
+		/* Closing the removed inode frees it, with its data. */
+		struct inode *inode = inode_open (inode_sector);
+
+		if (inode != NULL) {
+			inode_remove (inode);
+			inode_close (inode);
+			inode_sector = 0;
+		}
+		success = false;
+	}
+	if (!success && inode_sector != 0) {
+		journal_begin ();
+#ifdef EFILESYS
+		fat_remove_chain (inode_clst, 0);
+#else
 		free_map_release (inode_sector, 1);
+#endif
+		journal_end ();
+	}
 	dir_close (dir);
 
 	return success;
@@ -97,6 +145,7 @@ bool
 filesys_remove (const char *name) {
 	struct dir *dir = dir_open_root ();
 	bool success = dir != NULL && dir_remove (dir, name);
+
 	dir_close (dir);
 
 	return success;
@@ -110,13 +159,50 @@ do_format (void) {
 #ifdef EFILESYS
 	/* Create FAT and save it to the disk. */
 	fat_create ();
+	if (!dir_create (ROOT_DIR_SECTOR, 16))
+		PANIC ("root directory creation failed");
+	journal_commit ();
 	fat_close ();
 #else
 	free_map_create ();
 	if (!dir_create (ROOT_DIR_SECTOR, 16))
 		PANIC ("root directory creation failed");
+	journal_commit ();
 	free_map_close ();
 #endif
 
 	printf ("done.\n");
 }
+
+/* Prints how many runs of consecutive sectors the files in the root
+ * directory take on disk, on average, and whether allocation is delayed.
+ * Running a workload once as is and once with -eager-alloc compares the
+ * two. */
+static void
+report_fragmentation (void) {
+	struct dir *dir = dir_open_root ();
+	char name[NAME_MAX + 1];
+	size_t file_cnt = 0, extent_cnt = 0;
+
+	if (dir == NULL)
+		return;
+	while (dir_readdir (dir, name)) {
+		struct inode *inode;
+
+		if (dir_lookup (dir, name, &inode)) {
+			if (inode_length (inode) > 0) {
+				file_cnt++;
+				extent_cnt += inode_extent_cnt (inode);
+			}
+			inode_close (inode);
+		}
+	}
+	dir_close (dir);
+
+	if (file_cnt > 0)
+		printf ("Fragmentation (%s allocation): %zu files, %zu extents, "
+				"%zu.%02zu per file\n",
+				inode_delay_alloc ? "delayed" : "eager",
+				file_cnt, extent_cnt, extent_cnt / file_cnt,
+				extent_cnt * 100 / file_cnt % 100);
+}
@@ -4,9 +4,13 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static size_t free_cnt;              /* Sectors free in FREE_MAP. */
+static size_t reserved_cnt;          /* Of those, sectors promised by
+                                        free_map_reserve(). */
 
 /* Initializes the free map. */
 void
@@ -16,32 +20,85 @@ free_map_init (void) {
 		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	bitmap_set_multiple (free_map, journal_start (), JOURNAL_SECTORS, true);
+	free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
- * the first into *SECTORP.
+ * the first into *SECTORP.  Sectors promised by free_map_reserve() are
+ * not taken.
  * Returns true if successful, false if all sectors were
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+	disk_sector_t sector = BITMAP_ERROR;
+
+	if (free_cnt >= reserved_cnt + cnt)
+		sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
 	if (sector != BITMAP_ERROR
 			&& free_map_file != NULL
 			&& !bitmap_write (free_map, free_map_file)) {
 		bitmap_set_multiple (free_map, sector, cnt, false);
 		sector = BITMAP_ERROR;
 	}
-	if (sector != BITMAP_ERROR)
+	if (sector != BITMAP_ERROR) {
 		*sectorp = sector;
+		free_cnt -= cnt;
+	}
 	return sector != BITMAP_ERROR;
 }
 
+/* Allocates as many of the CNT sectors starting at SECTOR as are free
+ * in a row, so that an extent ending just before SECTOR can grow in
+ * place.
+ * Returns the number of sectors allocated, possibly 0. */
+size_t
+free_map_extend (disk_sector_t sector, size_t cnt) {
+	size_t n = 0;
+
+	if (cnt > free_cnt - reserved_cnt)
+		cnt = free_cnt - reserved_cnt;
+
+	while (n < cnt && sector + n < bitmap_size (free_map)
+			&& !bitmap_test (free_map, sector + n))
+		n++;
+	if (n == 0)
+		return 0;
+	bitmap_set_multiple (free_map, sector, n, true);
+	if (free_map_file != NULL && !bitmap_write (free_map, free_map_file)) {
+		bitmap_set_multiple (free_map, sector, n, false);
+		n = 0;
+	}
+	free_cnt -= n;
+	return n;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
 	bitmap_write (free_map, free_map_file);
+	free_cnt += cnt;
+}
+
+/* Promises CNT free sectors to a later free_map_allocate() or
+ * free_map_extend(), which only the caller may take, after giving them
+ * back with free_map_unreserve().
+ * Returns false if fewer are free. */
+bool
+free_map_reserve (size_t cnt) {
+	if (free_cnt < reserved_cnt + cnt)
+		return false;
+	reserved_cnt += cnt;
+	return true;
+}
+
+/* Gives back CNT sectors promised by free_map_reserve(). */
+void
+free_map_unreserve (size_t cnt) {
+	ASSERT (cnt <= reserved_cnt);
+	reserved_cnt -= cnt;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -50,8 +107,10 @@ free_map_open (void) {
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
+	inode_set_metadata (file_get_inode (free_map_file));
 	if (!bitmap_read (free_map, free_map_file))
 		PANIC ("can't read free map");
+	free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -72,6 +131,7 @@ free_map_create (void) {
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
+	inode_set_metadata (file_get_inode (free_map_file));
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
 }
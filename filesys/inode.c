@@ -1,22 +1,50 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/buffer-cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of consecutive data sectors on disk. */
+struct extent {
+	disk_sector_t start;                /* First sector. */
+	uint32_t length;                    /* Number of sectors. */
+};
+
+/* Extents held by the inode itself and by each indirect extent block. */
+#define INLINE_EXTENTS 61
+#define BLOCK_EXTENTS 63
+
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
+	disk_sector_t start;                /* First data cluster with EFILESYS,
+	                                       0 if none. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t extent_cnt;                /* Number of extents of the data. */
+	disk_sector_t indirect;             /* First indirect extent block,
+	                                       0 if none. */
+	struct extent extents[INLINE_EXTENTS]; /* First extents of the data. */
+	uint32_t unused[1];                 /* Not used. */
+};
+
+/* Indirect extent block, holding the extents of a file past the ones
+ * that fit in its inode.  Blocks are chained through NEXT. */
+struct extent_block {
+	disk_sector_t next;                 /* Next block, 0 if none. */
+	uint32_t unused;                    /* Not used. */
+	struct extent extents[BLOCK_EXTENTS]; /* Extents. */
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -26,37 +54,639 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
+/* A run of consecutive sectors (clusters with EFILESYS) of the data of
+ * a file. */
+struct run {
+	off_t start;                        /* File sector held by FIRST. */
+	disk_sector_t first;                /* First sector of the run. */
+	off_t length;                       /* Sectors in the run. */
+};
+
+/* Closed inodes kept in memory, so that reopening them skips reading
+ * and decoding the inode. */
+#define CLOSED_INODES 32
+
+/* Most sectors a file may grow by before they get disk space.  Their
+ * data waits in memory, so that a file written a little at a time gets
+ * one run of sectors instead of sectors interleaved with other files. */
+#define DELAY_SECTORS 32
+
+/* Whether to delay allocation at all; -eager-alloc clears it, so that
+ * the fragmentation of a workload may be compared both ways. */
+bool inode_delay_alloc = true;
+
+/* Most sectors a file grows or shrinks by in one journal operation, so
+ * that each changes few sectors of the free map or FAT. */
+#define STEP_SECTORS 8
+
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in inode table. */
+	struct list_elem closed_elem;       /* Element in closed inode list. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	bool meta;                          /* Data is file system metadata? */
+	void *aux;                          /* Kept by the inode's user. */
+	struct lock lock;                   /* Protects the members below. Page
+	                                       faults read files without
+	                                       filesys_lock. */
 	struct inode_disk data;             /* Inode content. */
+	off_t length;                       /* File size, with DELAYED. */
+	size_t reserved;                    /* Free sectors promised to the
+	                                       sectors in DELAYED. */
+	uint8_t *delayed;                   /* Data of the sectors past those
+	                                       with disk space, or NULL. */
+	struct run *runs;                   /* Data by runs, or NULL. */
+	size_t run_cnt;                     /* Number of RUNS. */
+	size_t run_cap;                     /* Capacity of RUNS. */
+#ifdef EFILESYS
+	unsigned run_gen;                   /* FAT generation RUNS are from. */
+#endif
 };
 
+/* Writes SIZE bytes from BUFFER at OFS in SECTOR of the data of INODE,
+ * through the journal if the data is metadata. */
+static void
+write_data (const struct inode *inode, disk_sector_t sector,
+		const void *buffer, int ofs, int size) {
+	if (inode->meta)
+		buffer_cache_write_meta (sector, buffer, ofs, size);
+	else
+		buffer_cache_write (sector, buffer, ofs, size);
+}
+
+/* Returns the number of sectors of INODE's data with disk space. */
+static inline size_t
+allocated_sectors (const struct inode *inode) {
+	return bytes_to_sectors (inode->data.length);
+}
+
+/* Appends LENGTH sectors starting at FIRST to the runs of INODE,
+ * merging them into the last run if they follow it on disk.
+ * Returns false if out of memory. */
+static bool
+push_run (struct inode *inode, disk_sector_t first, off_t length) {
+	struct run *last = inode->run_cnt > 0
+		? &inode->runs[inode->run_cnt - 1] : NULL;
+	off_t start = last != NULL ? last->start + last->length : 0;
+
+	if (last != NULL && last->first + last->length == first) {
+		last->length += length;
+		return true;
+	}
+	if (inode->run_cnt == inode->run_cap) {
+		size_t capacity = inode->run_cap > 0 ? inode->run_cap * 2 : 4;
+		struct run *runs = realloc (inode->runs, capacity * sizeof *runs);
+		if (runs == NULL)
+			return false;
+		inode->runs = runs;
+		inode->run_cap = capacity;
+	}
+	inode->runs[inode->run_cnt++] = (struct run) {
+		.start = start,
+		.first = first,
+		.length = length,
+	};
+	return true;
+}
+
+/* Returns the sector (cluster with EFILESYS) holding sector IDX of
+ * INODE's data, which the runs of INODE must cover. */
+static disk_sector_t
+run_lookup (const struct inode *inode, off_t idx) {
+	size_t lo = 0, hi = inode->run_cnt;
+
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (inode->runs[mid].start <= idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return inode->runs[lo].first + (idx - inode->runs[lo].start);
+}
+
+#ifdef EFILESYS
+/* Reads the chain of INODE's data into its list of runs, so that finding
+ * a sector takes a binary search instead of a walk down the chain.
+ * Returns false if out of memory. */
+static bool
+load_runs (struct inode *inode) {
+	cluster_t clst = inode->data.start;
+
+	inode->run_cnt = 0;
+	inode->run_gen = fat_chain_generation ();
+	for (; clst != 0 && clst != EOChain; clst = fat_get (clst))
+		if (!push_run (inode, clst, 1)) {
+			free (inode->runs);
+			inode->runs = NULL;
+			inode->run_cnt = inode->run_cap = 0;
+			return false;
+		}
+	return true;
+}
+
+/* Returns true if the runs of INODE are current and hold file sector
+ * IDX. */
+static bool
+runs_cover (const struct inode *inode, off_t idx) {
+	const struct run *last;
+
+	if (inode->run_cnt == 0 || inode->run_gen != fat_chain_generation ())
+		return false;
+	last = &inode->runs[inode->run_cnt - 1];
+	return idx < last->start + last->length;
+}
+
+/* Returns the cluster holding sector IDX of INODE's data. */
+static cluster_t
+sector_cluster (struct inode *inode, off_t idx) {
+	if (!runs_cover (inode, idx)
+			&& (!load_runs (inode) || !runs_cover (inode, idx))) {
+		/* No memory for the runs: walk the chain. */
+		cluster_t clst = inode->data.start;
+		for (; idx > 0; idx--)
+			clst = fat_get (clst);
+		return clst;
+	}
+	return run_lookup (inode, idx);
+}
+
+/* Adds CNT clusters to the end of the data of INODE, which has OLD_CNT
+ * now, filled from SRC, or zeroed if SRC is null.  The FAT prefers the
+ * cluster right after the tail, so clusters added together stay
+ * contiguous.
+ * Returns true if successful, false if the disk is full. */
+static bool
+allocate_sectors (struct inode *inode, size_t old_cnt, size_t cnt,
+		const uint8_t *src) {
+	static uint8_t zeros[DISK_SECTOR_SIZE];
+	cluster_t tail = old_cnt > 0 ? sector_cluster (inode, old_cnt - 1) : 0;
+	cluster_t first = 0, clst = tail;
+	bool current = old_cnt == 0 || runs_cover (inode, old_cnt - 1);
+
+	if (old_cnt == 0) {
+		inode->run_cnt = 0;
+		inode->run_gen = fat_chain_generation ();
+	}
+
+	while (cnt-- > 0) {
+		clst = fat_create_chain (clst);
+		if (clst == 0) {
+			if (first != 0)
+				fat_remove_chain (first, tail);
+			return false;
+		}
+		if (first == 0)
+			first = clst;
+		write_data (inode, cluster_to_sector (clst), src != NULL ? src : zeros,
+				0, DISK_SECTOR_SIZE);
+		if (src != NULL)
+			src += DISK_SECTOR_SIZE;
+
+		/* Keep the runs current; without memory they reload later. */
+		if (current && !push_run (inode, clst, 1))
+			current = false;
+	}
+	if (inode->data.start == 0)
+		inode->data.start = first;
+	if (!current)
+		inode->run_cnt = 0;
+	return true;
+}
+
+/* Frees the data of INODE from the end, STEP_SECTORS at a time, each
+ * step in a journal operation of its own. */
+static void
+release_sectors (struct inode *inode) {
+	size_t cnt = allocated_sectors (inode);
+
+	if (inode->data.start == 0)
+		return;
+	if (cnt > 0 && !runs_cover (inode, cnt - 1)
+			&& (!load_runs (inode) || !runs_cover (inode, cnt - 1)))
+		cnt = 0;
+
+	/* The runs stay good for the part of the chain left. */
+	while (cnt > STEP_SECTORS) {
+		cnt -= STEP_SECTORS;
+		journal_begin ();
+		fat_remove_chain (run_lookup (inode, cnt), run_lookup (inode, cnt - 1));
+		journal_end ();
+	}
+	journal_begin ();
+	fat_remove_chain (inode->data.start, 0);
+	journal_end ();
+	inode->data.start = 0;
+	inode->run_cnt = 0;
+}
+#else
+/* Reads the extents of INODE's data into its list of runs.
+ * Returns false if out of memory. */
+static bool
+load_extents (struct inode *inode) {
+	const struct inode_disk *data = &inode->data;
+	disk_sector_t sector = data->indirect;
+	struct extent_block *block = NULL;
+	size_t i;
+
+	for (i = 0; i < data->extent_cnt; i++) {
+		const struct extent *e;
+
+		if (i < INLINE_EXTENTS)
+			e = &data->extents[i];
+		else {
+			size_t ofs = (i - INLINE_EXTENTS) % BLOCK_EXTENTS;
+			if (ofs == 0) {
+				if (block == NULL && (block = malloc (sizeof *block)) == NULL)
+					return false;
+				buffer_cache_read (sector, block, 0, sizeof *block);
+				sector = block->next;
+			}
+			e = &block->extents[ofs];
+		}
+		if (!push_run (inode, e->start, e->length)) {
+			free (block);
+			return false;
+		}
+	}
+	free (block);
+	return true;
+}
+
+/* Writes the runs of INODE out as its extents, along with the inode
+ * itself, adding indirect extent blocks as needed.
+ * Returns true if successful, false if out of memory or disk space. */
+static bool
+save_extents (struct inode *inode) {
+	struct inode_disk *data = &inode->data;
+	struct extent_block *block = NULL;
+	disk_sector_t sector;
+	bool fresh = false;
+	size_t i;
+
+	for (i = 0; i < INLINE_EXTENTS; i++)
+		data->extents[i] = i < inode->run_cnt
+			? (struct extent) { inode->runs[i].first, inode->runs[i].length }
+			: (struct extent) { 0, 0 };
+
+	if (i < inode->run_cnt) {
+		block = malloc (sizeof *block);
+		if (block == NULL)
+			return false;
+		if (data->indirect == 0) {
+			if (!free_map_allocate (1, &data->indirect))
+				goto fail;
+			fresh = true;
+		}
+	}
+	for (sector = data->indirect; i < inode->run_cnt; i += BLOCK_EXTENTS) {
+		size_t j;
+
+		/* Reuse the rest of the chain, lengthening it if it runs out. */
+		block->next = 0;
+		if (!fresh)
+			buffer_cache_read (sector, &block->next, 0, sizeof block->next);
+		fresh = false;
+		if (i + BLOCK_EXTENTS < inode->run_cnt && block->next == 0) {
+			if (!free_map_allocate (1, &block->next))
+				goto fail;
+			fresh = true;
+		}
+
+		for (j = 0; j < BLOCK_EXTENTS; j++) {
+			const struct run *r = i + j < inode->run_cnt
+				? &inode->runs[i + j] : NULL;
+			block->extents[j] = r != NULL
+				? (struct extent) { r->first, r->length }
+				: (struct extent) { 0, 0 };
+		}
+		buffer_cache_write_meta (sector, block, 0, sizeof *block);
+		sector = block->next;
+	}
+	free (block);
+
+	data->extent_cnt = inode->run_cnt;
+	buffer_cache_write_meta (inode->sector, data, 0, DISK_SECTOR_SIZE);
+	return true;
+
+fail:
+	/* Blocks already linked stay in the chain and are reused. */
+	free (block);
+	return false;
+}
+
+/* Frees the sectors of INODE's data past the first CNT. */
+static void
+truncate_runs (struct inode *inode, size_t cnt) {
+	while (inode->run_cnt > 0) {
+		struct run *last = &inode->runs[inode->run_cnt - 1];
+		off_t end = last->start + last->length;
+
+		if (last->start >= (off_t) cnt) {
+			free_map_release (last->first, last->length);
+			inode->run_cnt--;
+		} else {
+			if (end > (off_t) cnt) {
+				free_map_release (last->first + (cnt - last->start),
+						end - cnt);
+				last->length = cnt - last->start;
+			}
+			break;
+		}
+	}
+}
+
+/* Adds CNT sectors to the end of the data of INODE, which has OLD_CNT
+ * now, filled from SRC, or zeroed if SRC is null, and writes out its
+ * extents.
+ * The last extent grows in place as far as the free map allows, so a
+ * file that grows alone stays contiguous.  The rest goes into a new
+ * extent, as long a run as the disk still has.
+ * Returns true if successful, false if out of memory or disk space. */
+static bool
+allocate_sectors (struct inode *inode, size_t old_cnt, size_t cnt,
+		const uint8_t *src) {
+	static uint8_t zeros[DISK_SECTOR_SIZE];
+
+	while (cnt > 0) {
+		struct run *last = inode->run_cnt > 0
+			? &inode->runs[inode->run_cnt - 1] : NULL;
+		disk_sector_t sector;
+		size_t n = 0, i;
+
+		if (last != NULL) {
+			sector = last->first + last->length;
+			n = free_map_extend (sector, cnt);
+		}
+		if (n == 0) {
+			for (n = cnt; n > 0 && !free_map_allocate (n, &sector); n /= 2)
+				continue;
+			if (n == 0)
+				goto fail;
+		}
+		if (!push_run (inode, sector, n)) {
+			free_map_release (sector, n);
+			goto fail;
+		}
+		for (i = 0; i < n; i++) {
+			write_data (inode, sector + i, src != NULL ? src : zeros, 0,
+					DISK_SECTOR_SIZE);
+			if (src != NULL)
+				src += DISK_SECTOR_SIZE;
+		}
+		cnt -= n;
+	}
+	if (save_extents (inode))
+		return true;
+
+fail:
+	truncate_runs (inode, old_cnt);
+	return false;
+}
+
+/* Frees the data of INODE from the end, STEP_SECTORS at a time, each
+ * step in a journal operation of its own, and then its indirect extent
+ * blocks. */
+static void
+release_sectors (struct inode *inode) {
+	size_t cnt = allocated_sectors (inode);
+	disk_sector_t sector = inode->data.indirect;
+
+	while (cnt > 0) {
+		cnt = cnt > STEP_SECTORS ? cnt - STEP_SECTORS : 0;
+		journal_begin ();
+		truncate_runs (inode, cnt);
+		journal_end ();
+	}
+	journal_begin ();
+	while (sector != 0) {
+		disk_sector_t next;
+
+		buffer_cache_read (sector, &next, 0, sizeof next);
+		free_map_release (sector, 1);
+		sector = next;
+	}
+	journal_end ();
+	inode->data.indirect = 0;
+}
+#endif
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
- * POS. */
+ * POS, or the data has no disk space yet. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if ((size_t) pos / DISK_SECTOR_SIZE < allocated_sectors (inode)) {
+#ifdef EFILESYS
+		return cluster_to_sector (sector_cluster (inode,
+					pos / DISK_SECTOR_SIZE));
+#else
+		return run_lookup (inode, pos / DISK_SECTOR_SIZE);
+#endif
+	} else
 		return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Promises CNT free sectors to the delayed data of INODE, so that no
+ * other file takes them before it gets disk space.
+ * Returns false if the disk does not have them. */
+static bool
+reserve_sectors (struct inode *inode, size_t cnt) {
+#ifdef EFILESYS
+	if (!fat_reserve (cnt))
+		return false;
+#else
+	if (!free_map_reserve (cnt))
+		return false;
+#endif
+	inode->reserved += cnt;
+	return true;
+}
+
+/* Gives back the free sectors promised to INODE. */
+static void
+unreserve_sectors (struct inode *inode) {
+#ifdef EFILESYS
+	fat_unreserve (inode->reserved);
+#else
+	free_map_unreserve (inode->reserved);
+#endif
+	inode->reserved = 0;
+}
+
+/* Returns the data at byte offset POS of INODE if it has no disk space
+ * yet, or a null pointer. */
+static uint8_t *
+delayed_data (const struct inode *inode, off_t pos) {
+	size_t idx = pos / DISK_SECTOR_SIZE;
+	size_t alloc_cnt = allocated_sectors (inode);
+
+	if (inode->delayed == NULL || idx < alloc_cnt)
+		return NULL;
+	return inode->delayed + (idx - alloc_cnt) * DISK_SECTOR_SIZE
+		+ pos % DISK_SECTOR_SIZE;
+}
+
+/* Gives disk space to the sectors of INODE that wait for it, all in as
+ * few runs as the disk allows, taking the free sectors promised to them,
+ * and writes the inode back.  INODE's lock must be held.
+ * Returns true if successful, false if out of memory or disk space, in
+ * which case the data keeps waiting. */
+static bool
+inode_writeback (struct inode *inode) {
+	size_t alloc_cnt = allocated_sectors (inode);
+	size_t cnt = bytes_to_sectors (inode->length) - alloc_cnt;
+	bool success = true;
+
+	ASSERT (lock_held_by_current_thread (&inode->lock));
+
+	if (inode->delayed == NULL)
+		return true;
+	if (cnt > 0) {
+		journal_begin ();
+		unreserve_sectors (inode);
+		success = allocate_sectors (inode, alloc_cnt, cnt, inode->delayed);
+		if (success) {
+			inode->data.length = inode->length;
+			buffer_cache_write_meta (inode->sector, &inode->data, 0,
+					DISK_SECTOR_SIZE);
+		} else
+			reserve_sectors (inode, cnt);
+		journal_end ();
+	}
+	if (success) {
+		free (inode->delayed);
+		inode->delayed = NULL;
+	}
+	return success;
+}
+
+/* Extends INODE to LENGTH bytes, zero-filled, and writes the inode back.
+ * If DELAY is true, new sectors of a regular file may wait in memory for
+ * disk space until inode_writeback(), with free sectors promised to
+ * them so that they are sure to get it.
+ * Returns true if successful, false if out of memory or disk space. */
+static bool
+inode_grow (struct inode *inode, off_t length, bool delay) {
+	size_t alloc_cnt = allocated_sectors (inode);
+	size_t old_cnt = bytes_to_sectors (inode->length);
+	size_t new_cnt = bytes_to_sectors (length);
+
+	if (delay && inode_delay_alloc && !inode->meta && new_cnt > alloc_cnt
+			&& new_cnt - alloc_cnt <= DELAY_SECTORS) {
+		if (inode->delayed == NULL)
+			inode->delayed = calloc (DELAY_SECTORS, DISK_SECTOR_SIZE);
+		if (inode->delayed != NULL) {
+			/* The disk is full: the write comes up short. */
+			if (new_cnt > old_cnt
+					&& !reserve_sectors (inode, new_cnt - old_cnt))
+				return false;
+			inode->length = length;
+			return true;
+		}
+	}
+
+	/* Too much to hold back: allocate what waits along with the rest. */
+	if (!inode_writeback (inode))
+		return false;
+	alloc_cnt = allocated_sectors (inode);
+	if (new_cnt > alloc_cnt
+			&& !allocate_sectors (inode, alloc_cnt, new_cnt - alloc_cnt, NULL))
+		return false;
+	inode->length = inode->data.length = length;
+	buffer_cache_write_meta (inode->sector, &inode->data, 0,
+			DISK_SECTOR_SIZE);
+	return true;
+}
+
+/* Extends INODE to LENGTH bytes as inode_grow() does, STEP_SECTORS at a
+ * time, each step in a journal operation of its own.  INODE's lock must
+ * be held.
+ * Returns true if successful, false if out of memory or disk space, in
+ * which case INODE keeps the steps it took. */
+static bool
+inode_grow_steps (struct inode *inode, off_t length, bool delay) {
+	ASSERT (lock_held_by_current_thread (&inode->lock));
+
+	while (inode->length < length) {
+		off_t step = ROUND_DOWN (inode->length, DISK_SECTOR_SIZE)
+			+ STEP_SECTORS * DISK_SECTOR_SIZE;
+		bool success;
+
+		journal_begin ();
+		success = inode_grow (inode, step < length ? step : length, delay);
+		journal_end ();
+		if (!success)
+			return false;
+	}
+	return true;
+}
+
+/* Table of inodes in memory by sector, so that opening a single inode
+ * twice returns the same `struct inode'.  Holds the open inodes and the
+ * most recently closed ones, which are also in CLOSED_LIST from least
+ * to most recently closed. */
+static struct hash inode_table;
+static struct list closed_list;
+
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct inode *inode = hash_entry (e, struct inode, elem);
+	return hash_int (inode->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	const struct inode *ia = hash_entry (a, struct inode, elem);
+	const struct inode *ib = hash_entry (b, struct inode, elem);
+	return ia->sector < ib->sector;
+}
+
+/* Returns the inode in memory for SECTOR, or a null pointer. */
+static struct inode *
+inode_lookup (disk_sector_t sector) {
+	struct inode key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&inode_table, &key.elem);
+	return e != NULL ? hash_entry (e, struct inode, elem) : NULL;
+}
+
+/* Gives disk space to the data of INODE, taking its lock.
+ * Returns true if successful. */
+static bool
+inode_writeback_locked (struct inode *inode) {
+	bool success;
+
+	lock_acquire (&inode->lock);
+	success = inode_writeback (inode);
+	lock_release (&inode->lock);
+	return success;
+}
+
+/* Frees INODE, which nobody has open. */
+static void
+inode_free (struct inode *inode) {
+	hash_delete (&inode_table, &inode->elem);
+	unreserve_sectors (inode);
+	free (inode->delayed);
+	free (inode->runs);
+	free (inode->aux);
+	free (inode);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	hash_init (&inode_table, inode_hash, inode_less, NULL);
+	list_init (&closed_list);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -67,6 +697,7 @@ inode_init (void) {
 bool
 inode_create (disk_sector_t sector, off_t length) {
 	struct inode_disk *disk_inode = NULL;
+	struct inode *inode;
 	bool success = false;
 
 	ASSERT (length >= 0);
@@ -74,24 +705,36 @@ inode_create (disk_sector_t sector, off_t length) {
 	/* If this assertion fails, the inode structure is not exactly
 	 * one sector in size, and you should fix that. */
 	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
+	ASSERT (sizeof (struct extent_block) == DISK_SECTOR_SIZE);
 
+	/* Write an empty inode, then grow it like any other file.  A closed
+	 * inode kept for SECTOR is stale once the sector is reused. */
+	inode = inode_lookup (sector);
+	if (inode != NULL) {
+		ASSERT (inode->open_cnt == 0);
+		list_remove (&inode->closed_elem);
+		inode_free (inode);
+	}
 	disk_inode = calloc (1, sizeof *disk_inode);
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
+		journal_begin ();
+		buffer_cache_write_meta (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+		journal_end ();
 		free (disk_inode);
+
+		/* The caller frees SECTOR on failure, but not the data. */
+		inode = inode_open (sector);
+		if (inode != NULL) {
+			lock_acquire (&inode->lock);
+			success = inode_grow_steps (inode, length, false);
+			if (!success) {
+				release_sectors (inode);
+				inode->length = inode->data.length = 0;
+			}
+			lock_release (&inode->lock);
+			inode_close (inode);
+		}
 	}
 	return success;
 }
@@ -101,17 +744,14 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
 	struct inode *inode;
 
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
+	/* Check whether this inode is already in memory. */
+	inode = inode_lookup (sector);
+	if (inode != NULL) {
+		if (inode->open_cnt == 0)
+			list_remove (&inode->closed_elem);
+		return inode_reopen (inode);
 	}
 
 	/* Allocate memory. */
@@ -120,12 +760,27 @@ inode_open (disk_sector_t sector) {
 		return NULL;
 
 	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode->meta = false;
+	inode->aux = NULL;
+	lock_init (&inode->lock);
+	inode->reserved = 0;
+	inode->delayed = NULL;
+	inode->runs = NULL;
+	inode->run_cnt = inode->run_cap = 0;
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	inode->length = inode->data.length;
+#ifndef EFILESYS
+	if (!load_extents (inode)) {
+		free (inode->runs);
+		free (inode);
+		return NULL;
+	}
+#endif
+	hash_insert (&inode_table, &inode->elem);
 	return inode;
 }
 
@@ -143,8 +798,30 @@ inode_get_inumber (const struct inode *inode) {
 	return inode->sector;
 }
 
+/* Frees the least recently closed inodes past CLOSED_INODES.  One whose
+ * data cannot get disk space stays, so that the data is not lost; it is
+ * tried again on the next close. */
+static void
+evict_closed (void) {
+	struct list_elem *e = list_begin (&closed_list);
+
+	while (list_size (&closed_list) > CLOSED_INODES
+			&& e != list_end (&closed_list)) {
+		struct inode *victim = list_entry (e, struct inode, closed_elem);
+
+		e = list_next (e);
+		if (inode_writeback_locked (victim)) {
+			list_remove (&victim->closed_elem);
+			inode_free (victim);
+		}
+	}
+}
+
 /* Closes INODE and writes it to disk.
- * If this was the last reference to INODE, frees its memory.
+ * If this was the last reference to INODE, gives disk space to its data
+ * and frees its memory, keeping it among the recently closed inodes
+ * unless it was removed.  An inode whose data could not get disk space
+ * stays among them until it does.
  * If INODE was also a removed inode, frees its blocks. */
 void
 inode_close (struct inode *inode) {
@@ -154,20 +831,49 @@ inode_close (struct inode *inode) {
 
 	/* Release resources if this was the last opener. */
 	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
-
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
+			release_sectors (inode);
+			journal_begin ();
+#ifdef EFILESYS
+			fat_remove_chain (sector_to_cluster (inode->sector), 0);
+#else
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+#endif
+			journal_end ();
+			inode_free (inode);
+			return;
 		}
 
-		free (inode); 
+		inode_writeback_locked (inode);
+		list_push_back (&closed_list, &inode->closed_elem);
+		evict_closed ();
 	}
 }
 
+/* Marks the data of INODE as file system metadata, such as a directory,
+ * so that writes to it go through the journal. */
+void
+inode_set_metadata (struct inode *inode) {
+	inode->meta = true;
+}
+
+/* Returns the data kept with INODE by inode_set_aux(), or a null
+ * pointer. */
+void *
+inode_get_aux (const struct inode *inode) {
+	return inode->aux;
+}
+
+/* Keeps AUX, from malloc(), with INODE for as long as INODE is in
+ * memory, such as a copy of data read from it often.  It is freed along
+ * with INODE. */
+void
+inode_set_aux (struct inode *inode, void *aux) {
+	free (inode->aux);
+	inode->aux = aux;
+}
+
 /* Marks INODE to be deleted when it is closed by the last caller who
  * has it open. */
 void
@@ -183,12 +889,12 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
+	lock_acquire (&inode->lock);
 	while (size > 0) {
-		/* Disk sector to read, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		/* Starting byte offset within sector. */
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
+		uint8_t *delayed;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
 		off_t inode_left = inode_length (inode) - offset;
@@ -200,50 +906,59 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		delayed = delayed_data (inode, offset);
+		if (delayed != NULL)
+			memcpy (buffer + bytes_read, delayed, chunk_size);
+		else
+			buffer_cache_read (byte_to_sector (inode, offset),
+					buffer + bytes_read, sector_ofs, chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
+	lock_release (&inode->lock);
 
 	return bytes_read;
 }
 
+/* Starts reading the SIZE bytes of INODE at OFFSET into the buffer cache
+ * in the background. */
+void
+inode_read_ahead (struct inode *inode, off_t size, off_t offset) {
+	off_t end = offset + size;
+
+	lock_acquire (&inode->lock);
+	/* Sectors without disk space are in memory already. */
+	if (end > inode->data.length)
+		end = inode->data.length;
+	offset -= offset % DISK_SECTOR_SIZE;
+	for (; offset < end; offset += DISK_SECTOR_SIZE)
+		buffer_cache_read_ahead (byte_to_sector (inode, offset));
+	lock_release (&inode->lock);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk is full or an error occurs.
+ * A write past end of file extends the inode, zero-filling any gap. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
 
 	if (inode->deny_write_cnt)
 		return 0;
+	lock_acquire (&inode->lock);
+	if (size > 0 && offset + size > inode_length (inode))
+		inode_grow_steps (inode, offset + size, true);
 
 	while (size > 0) {
-		/* Sector to write, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		/* Starting byte offset within sector. */
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
+		uint8_t *delayed;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
 		off_t inode_left = inode_length (inode) - offset;
@@ -255,34 +970,20 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* The cache reads the rest of a partly written sector. */
+		delayed = delayed_data (inode, offset);
+		if (delayed != NULL)
+			memcpy (delayed, buffer + bytes_written, chunk_size);
+		else
+			write_data (inode, byte_to_sector (inode, offset),
+					buffer + bytes_written, sector_ofs, chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
+	lock_release (&inode->lock);
 
 	return bytes_written;
 }
@@ -309,5 +1010,36 @@ inode_allow_write (struct inode *inode) {
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode) {
-	return inode->data.length;
+	return inode->length;
+}
+
+/* Returns the number of runs of consecutive sectors INODE's data takes
+ * on disk. */
+size_t
+inode_extent_cnt (struct inode *inode) {
+	size_t cnt;
+
+	lock_acquire (&inode->lock);
+#ifdef EFILESYS
+	load_runs (inode);
+#endif
+	cnt = inode->run_cnt;
+	lock_release (&inode->lock);
+	return cnt;
+}
+
+static void
+writeback_action (struct hash_elem *e, void *aux UNUSED) {
+	struct inode *inode = hash_entry (e, struct inode, elem);
+
+	if (!inode_writeback_locked (inode))
+		printf ("inode %"PRDSNu": no disk space for delayed data\n",
+				inode->sector);
+}
+
+/* Gives disk space to the data of every inode in memory, before the
+ * file system goes away. */
+void
+inode_done (void) {
+	hash_apply (&inode_table, writeback_action);
 }
@@ -0,0 +1,368 @@
+/* journal.c: Write-ahead journal of file system metadata.
+
+   Metadata sectors (inodes, extent blocks, directories, the free map and
+   the FAT) are changed in the buffer cache, and held there until the
+   transaction that changed them is committed.  A commit writes every
+   such sector into the journal, a circular log at the end of the disk,
+   as a descriptor naming their home sectors, the sectors themselves and
+   a commit record, one after the other.  Only then may they go home.
+   Once the log fills up, a checkpoint writes everything home and starts
+   the log over.  At boot, committed transactions still in the log are
+   copied home again, so the metadata on disk is always that of some
+   commit, however the system stopped.
+
+   Each operation that changes metadata runs between journal_begin() and
+   journal_end(), and a commit waits for none to be running, so that it
+   never catches one half done.  Operations are grouped: a transaction
+   holds all those since the last commit, which happens every
+   COMMIT_INTERVAL or as soon as enough sectors are waiting.
+
+   A transaction must fit one descriptor, and its sectors must fit the
+   buffer cache, which cannot evict them before the commit.  So no
+   operation changes more than about OP_SECTORS sectors, larger ones
+   such as growing a file being split into steps, and journal_begin()
+   keeps that much room for each operation running, committing first if
+   the transaction has none left. */
+
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/buffer-cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Identify journal sectors. */
+#define HEADER_MAGIC 0x4a4e4c48         /* "JNLH" */
+#define DESC_MAGIC 0x4a4e4c44           /* "JNLD" */
+#define COMMIT_MAGIC 0x4a4e4c43         /* "JNLC" */
+
+/* Sectors of the log, which follows the header. */
+#define LOG_SECTORS (JOURNAL_SECTORS - 1)
+
+/* Most sectors in one transaction, as many as a descriptor names. */
+#define TXN_MAX ((DISK_SECTOR_SIZE - 3 * sizeof (uint32_t)) \
+		/ sizeof (disk_sector_t))
+
+/* Transactions are committed this often, and as soon as GROUP_SECTORS
+ * sectors wait for a commit. */
+#define COMMIT_INTERVAL (5 * TIMER_FREQ)
+#define GROUP_SECTORS 16
+
+/* Most sectors one operation changes, and most sectors in a transaction,
+ * leaving the rest of the buffer cache for sectors in use. */
+#define OP_SECTORS 16
+#define TXN_SECTORS 48
+
+/* First sector of the journal. */
+struct journal_header {
+	uint32_t magic;                     /* HEADER_MAGIC. */
+	uint32_t start;                     /* Log sector of the first
+	                                       transaction not yet home. */
+	uint32_t seq;                       /* Its sequence number. */
+	uint8_t unused[DISK_SECTOR_SIZE - 3 * sizeof (uint32_t)];
+};
+
+/* Descriptor or commit record of a transaction. */
+struct journal_record {
+	uint32_t magic;                     /* DESC_MAGIC or COMMIT_MAGIC. */
+	uint32_t seq;                       /* Sequence number. */
+	uint32_t cnt;                       /* Sectors in the transaction. */
+	disk_sector_t sectors[TXN_MAX];     /* Their home, in a descriptor. */
+};
+
+/* The log: where it starts and ends, and the next sequence number.
+ * Guarded by JOURNAL_LOCK, held throughout a commit. */
+static struct lock journal_lock;
+static uint32_t log_start, log_head, next_seq;
+
+/* Operations running, and IDLE to wait for them all to end.  RESERVED
+ * sectors are kept in the transaction for them, and ROOM is signaled
+ * when one ends. */
+static int active_cnt;
+static size_t reserved;
+static struct condition idle;
+static struct condition room;
+
+/* Descriptor, sectors and commit record of the transaction being
+ * committed or replayed. */
+static struct journal_record *record;
+static uint8_t *txn_data;
+static struct journal_record *commit_record;
+
+/* Statistics. */
+static long long commit_cnt;            /* Transactions committed. */
+static long long checkpoint_cnt;        /* Times the log was emptied. */
+
+static void commit (void);
+static void committer (void *aux);
+
+/* Returns the first sector of the journal. */
+disk_sector_t
+journal_start (void) {
+	return disk_size (filesys_disk) - JOURNAL_SECTORS;
+}
+
+/* Returns the disk sector of log sector POS. */
+static disk_sector_t
+log_sector (uint32_t pos) {
+	return journal_start () + 1 + pos % LOG_SECTORS;
+}
+
+/* Writes the header, saying the log starts at LOG_START. */
+static void
+write_header (void) {
+	struct journal_header *h = calloc (1, sizeof *h);
+
+	if (h == NULL)
+		PANIC ("journal header allocation failed");
+	h->magic = HEADER_MAGIC;
+	h->start = log_start;
+	h->seq = next_seq;
+	disk_write (filesys_disk, journal_start (), h);
+	free (h);
+}
+
+/* Copies home every committed transaction in the log, and empties it.
+ * Returns the number of transactions copied. */
+static int
+replay (void) {
+	struct journal_header *h = malloc (sizeof *h);
+	struct journal_record *commit = commit_record;
+	uint8_t *buf = txn_data;
+	int replayed = 0;
+
+	if (h == NULL)
+		PANIC ("journal replay allocation failed");
+
+	disk_read (filesys_disk, journal_start (), h);
+	if (h->magic != HEADER_MAGIC) {
+		/* No journal yet: nothing to replay. */
+		log_start = 0;
+		next_seq = 1;
+	} else {
+		log_start = h->start % LOG_SECTORS;
+		next_seq = h->seq;
+		for (;;) {
+			uint32_t i;
+
+			disk_read (filesys_disk, log_sector (log_start), record);
+			if (record->magic != DESC_MAGIC || record->seq != next_seq
+					|| record->cnt == 0 || record->cnt > TXN_MAX)
+				break;
+			disk_read (filesys_disk,
+					log_sector (log_start + record->cnt + 1), commit);
+			if (commit->magic != COMMIT_MAGIC || commit->seq != next_seq)
+				break;
+
+			for (i = 0; i < record->cnt; i++) {
+				disk_read (filesys_disk, log_sector (log_start + 1 + i), buf);
+				disk_write (filesys_disk, record->sectors[i], buf);
+			}
+			log_start = (log_start + record->cnt + 2) % LOG_SECTORS;
+			next_seq++;
+			replayed++;
+		}
+	}
+	log_head = log_start;
+	write_header ();
+
+	free (h);
+	return replayed;
+}
+
+/* Initializes the journal, replaying what it holds or, if FORMAT is
+ * true, clearing it for a new file system, and starts committing. */
+void
+journal_init (bool format) {
+	int replayed;
+
+	ASSERT (TXN_SECTORS <= TXN_MAX);
+
+	lock_init (&journal_lock);
+	cond_init (&idle);
+	cond_init (&room);
+	record = malloc (sizeof *record);
+	commit_record = calloc (1, sizeof *commit_record);
+	txn_data = malloc (TXN_MAX * DISK_SECTOR_SIZE);
+	if (record == NULL || commit_record == NULL || txn_data == NULL)
+		PANIC ("journal allocation failed");
+
+	if (format) {
+		/* Old transactions must not be mistaken for new ones. */
+		uint32_t pos;
+
+		memset (txn_data, 0, DISK_SECTOR_SIZE);
+		for (pos = 0; pos < LOG_SECTORS; pos++)
+			disk_write (filesys_disk, log_sector (pos), txn_data);
+		log_start = log_head = 0;
+		next_seq = 1;
+		write_header ();
+	} else if ((replayed = replay ()) > 0)
+		printf ("Journal: replayed %d transactions\n", replayed);
+
+	thread_create ("committer", PRI_DEFAULT, committer, NULL);
+}
+
+/* Returns the number of metadata sectors waiting for a commit. */
+static size_t
+waiting (void) {
+	size_t cnt = buffer_cache_unlogged ();
+#ifdef EFILESYS
+	cnt += fat_unlogged ();
+#endif
+	return cnt;
+}
+
+/* Starts an operation that changes metadata.  Operations nest, the inner
+ * ones being part of the outermost, which waits until the transaction
+ * has room for OP_SECTORS more sectors, committing it if nothing else
+ * runs. */
+void
+journal_begin (void) {
+	struct thread *t = thread_current ();
+
+	if (t->journal_depth++ > 0)
+		return;
+
+	lock_acquire (&journal_lock);
+	while (reserved + waiting () + OP_SECTORS > TXN_SECTORS) {
+		if (active_cnt == 0)
+			commit ();
+		else
+			cond_wait (&room, &journal_lock);
+	}
+	active_cnt++;
+	reserved += OP_SECTORS;
+	lock_release (&journal_lock);
+}
+
+/* Ends an operation begun by journal_begin(), committing if enough
+ * sectors are waiting. */
+void
+journal_end (void) {
+	struct thread *t = thread_current ();
+	bool due;
+
+	ASSERT (t->journal_depth > 0);
+	if (--t->journal_depth > 0)
+		return;
+
+	lock_acquire (&journal_lock);
+	ASSERT (active_cnt > 0);
+	reserved -= OP_SECTORS;
+	if (--active_cnt == 0)
+		cond_broadcast (&idle, &journal_lock);
+	cond_broadcast (&room, &journal_lock);
+	due = active_cnt == 0 && waiting () >= GROUP_SECTORS;
+	lock_release (&journal_lock);
+
+	if (due)
+		journal_commit ();
+}
+
+/* Writes every metadata sector home and empties the log.
+ * Everything must be committed. */
+static void
+checkpoint (void) {
+	ASSERT (lock_held_by_current_thread (&journal_lock));
+
+	buffer_cache_flush ();
+#ifdef EFILESYS
+	fat_flush ();
+#endif
+	log_start = log_head;
+	write_header ();
+	checkpoint_cnt++;
+}
+
+/* Writes the metadata changed since the last commit to the log, as one
+ * transaction.  JOURNAL_LOCK must be held, with no operation running. */
+static void
+commit (void) {
+	size_t cnt, i;
+
+	ASSERT (lock_held_by_current_thread (&journal_lock));
+	ASSERT (active_cnt == 0);
+
+	/* Splitting it would commit part of an operation. */
+	cnt = waiting ();
+	if (cnt > TXN_MAX)
+		PANIC ("journal: transaction of %zu sectors too large", cnt);
+
+	cnt = buffer_cache_log (record->sectors, txn_data, TXN_MAX);
+#ifdef EFILESYS
+	cnt += fat_log (record->sectors + cnt,
+			txn_data + cnt * DISK_SECTOR_SIZE, TXN_MAX - cnt);
+#endif
+	if (cnt == 0)
+		return;
+
+	/* Descriptor, sectors and commit record, in order. */
+	record->magic = DESC_MAGIC;
+	record->seq = next_seq;
+	record->cnt = cnt;
+	disk_write (filesys_disk, log_sector (log_head), record);
+	for (i = 0; i < cnt; i++)
+		disk_write (filesys_disk, log_sector (log_head + 1 + i),
+				txn_data + i * DISK_SECTOR_SIZE);
+	commit_record->magic = COMMIT_MAGIC;
+	commit_record->seq = next_seq;
+	commit_record->cnt = cnt;
+	disk_write (filesys_disk, log_sector (log_head + cnt + 1),
+			commit_record);
+
+	/* Committed: the sectors may go home now. */
+	buffer_cache_logged (record->sectors, cnt);
+
+	log_head = (log_head + cnt + 2) % LOG_SECTORS;
+	next_seq++;
+	commit_cnt++;
+
+	/* Keep room for the largest transaction. */
+	if ((log_head + LOG_SECTORS - log_start) % LOG_SECTORS
+			> LOG_SECTORS - (TXN_MAX + 2))
+		checkpoint ();
+}
+
+/* Commits the metadata changed since the last commit.  Must not be
+ * called within an operation, which the commit would wait for. */
+void
+journal_commit (void) {
+	ASSERT (thread_current ()->journal_depth == 0);
+
+	lock_acquire (&journal_lock);
+	while (active_cnt > 0)
+		cond_wait (&idle, &journal_lock);
+	commit ();
+	lock_release (&journal_lock);
+}
+
+/* Commits what is waiting and writes everything home, before shutting
+ * down. */
+void
+journal_done (void) {
+	journal_commit ();
+	lock_acquire (&journal_lock);
+	checkpoint ();
+	lock_release (&journal_lock);
+}
+
+/* Commits every COMMIT_INTERVAL ticks, so that a crash loses little. */
+static void
+committer (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (COMMIT_INTERVAL);
+		journal_commit ();
+	}
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void) {
+	printf ("Journal: %lld commits, %lld checkpoints\n",
+			commit_cnt, checkpoint_cnt);
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+
+#include <stddef.h>
+#include "devices/disk.h"
+
+void buffer_cache_init (void);
+void buffer_cache_done (void);
+void buffer_cache_read (disk_sector_t, void *, int ofs, int size);
+void buffer_cache_write (disk_sector_t, const void *, int ofs, int size);
+void buffer_cache_write_meta (disk_sector_t, const void *, int ofs, int size);
+void buffer_cache_read_ahead (disk_sector_t);
+void buffer_cache_flush (void);
+void buffer_cache_print_stats (void);
+
+/* Journal support. */
+size_t buffer_cache_unlogged (void);
+size_t buffer_cache_log (disk_sector_t *, void *, size_t max);
+void buffer_cache_logged (const disk_sector_t *, size_t cnt);
+
+#endif /* filesys/buffer-cache.h */
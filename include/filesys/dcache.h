@@ -0,0 +1,15 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+void dcache_init (void);
+bool dcache_lookup (disk_sector_t dir, const char *name,
+		bool *existsp, disk_sector_t *sectorp);
+void dcache_insert (disk_sector_t dir, const char *name,
+		bool exists, disk_sector_t sector);
+void dcache_purge (disk_sector_t dir);
+void dcache_clear (void);
+
+#endif /* filesys/dcache.h */
@@ -23,6 +23,9 @@ void fat_open (void);
 void fat_close (void);
 void fat_create (void);
 void fat_close (void);
+void fat_flush (void);
+size_t fat_log (disk_sector_t *sectors, void *buffer, size_t max);
+size_t fat_unlogged (void);
 
 cluster_t fat_create_chain (
     cluster_t clst /* Cluster # to stretch, 0: Create a new chain */
@@ -31,8 +34,12 @@ void fat_remove_chain (
     cluster_t clst, /* Cluster # to be removed */
     cluster_t pclst /* Previous cluster of clst, 0: clst is the start of chain */
 );
+bool fat_reserve (size_t cnt);
+void fat_unreserve (size_t cnt);
+unsigned fat_chain_generation (void);
 cluster_t fat_get (cluster_t clst);
 void fat_put (cluster_t clst, cluster_t val);
 disk_sector_t cluster_to_sector (cluster_t clst);
+cluster_t sector_to_cluster (disk_sector_t sector);
 
 #endif /* filesys/fat.h */
@@ -15,6 +15,11 @@ struct file {
     /** #Project 2: Extend File Descriptor */
     int dup_count;
     /** ---------------------------------- */
+
+    /* Read-ahead, by file_read () only. */
+    off_t ra_next;       /* Where a sequential read would start. */
+    off_t ra_window;     /* Bytes to keep read ahead, 0 if random. */
+    off_t ra_end;        /* End of the bytes read ahead so far. */
 };
 
 /* Opening and closing files. */
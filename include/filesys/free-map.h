@@ -12,6 +12,9 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, disk_sector_t *);
+size_t free_map_extend (disk_sector_t, size_t);
 void free_map_release (disk_sector_t, size_t);
+bool free_map_reserve (size_t);
+void free_map_unreserve (size_t);
 
 #endif /* filesys/free-map.h */
@@ -2,22 +2,31 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/disk.h"
 
 struct bitmap;
 
+extern bool inode_delay_alloc;
+
 void inode_init (void);
+void inode_done (void);
 bool inode_create (disk_sector_t, off_t);
 struct inode *inode_open (disk_sector_t);
 struct inode *inode_reopen (struct inode *);
 disk_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+void inode_set_metadata (struct inode *);
+void *inode_get_aux (const struct inode *);
+void inode_set_aux (struct inode *, void *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+void inode_read_ahead (struct inode *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+size_t inode_extent_cnt (struct inode *);
 
 #endif /* filesys/inode.h */
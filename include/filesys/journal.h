@@ -0,0 +1,18 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Sectors at the end of the file system disk kept for the journal. */
+#define JOURNAL_SECTORS 256
+
+disk_sector_t journal_start (void);
+void journal_init (bool format);
+void journal_done (void);
+void journal_begin (void);
+void journal_end (void);
+void journal_commit (void);
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,17 @@
+#ifndef __LIB_MMAN_H
+#define __LIB_MMAN_H
+
+/* Or'd into the WRITABLE argument of mmap() to load the whole mapping
+ * right away. The kernel masks it off before looking at WRITABLE, which
+ * is otherwise 0 or 1, so that it cannot be taken for one. */
+#define MAP_POPULATE 0x8000
+
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_RANDOM 1           /* Expect random access: no fault-around. */
+#define MADV_SEQUENTIAL 2       /* Expect sequential access: read ahead,
+                                   drop behind. */
+#define MADV_WILLNEED 3         /* Will be needed: load now. */
+#define MADV_DONTNEED 4         /* Not needed: drop from memory. */
+
+#endif /* lib/mman.h */
@@ -0,0 +1,15 @@
+#ifndef __LIB_SPAWN_H
+#define __LIB_SPAWN_H
+
+/* A file descriptor action applied by spawn() in the child before it
+ * loads the new program: dup2 (FD, TARGET), or close (FD) if TARGET is
+ * SPAWN_CLOSE. A list of actions ends with one whose FD is negative. */
+struct spawn_action {
+	int fd;
+	int target;
+};
+
+#define SPAWN_CLOSE (-1)        /* Target that closes FD. */
+#define SPAWN_ACTION_MAX 16     /* Most actions one spawn() applies. */
+
+#endif /* lib/spawn.h */
@@ -36,6 +36,24 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Extra for Project 3 */
+	SYS_MADVISE,                /* Advise on the use of a mapping. */
+	SYS_VMSTAT,                 /* Memory counters of the process. */
+	SYS_MSYNC,                  /* Write a mapping back to its file. */
+	SYS_SHM_CREATE,             /* Create a shared memory segment. */
+	SYS_SHM_ATTACH,             /* Map a shared memory segment. */
+	SYS_SHM_DETACH,             /* Unmap a shared memory segment. */
+
+	/* Extra process creation. */
+	SYS_SPAWN,                  /* Start a program in a new process. */
+	SYS_VFORK,                  /* Clone sharing the address space. */
+
+	/* Resource limits. */
+	SYS_RSS_LIMIT,              /* Limit the pages kept in memory. */
+
+	/* Timing. */
+	SYS_TICKS,                  /* Timer ticks since boot. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <mman.h>
+#include <spawn.h>
+#include <vmstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -25,7 +29,10 @@ void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
 pid_t fork (const char *thread_name);
 int exec (const char *file);
+pid_t spawn (const char *file, const struct spawn_action *actions);
+pid_t vfork (void);
 int wait (pid_t);
+int64_t ticks (void);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int open (const char *file);
@@ -41,6 +48,13 @@ int dup2(int oldfd, int newfd);
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
+int madvise (void *addr, size_t length, int advice);
+int msync (void *addr, size_t length);
+int vmstat (struct vmstat *st);
+size_t rss_limit (size_t page_cnt);
+bool shm_create (int key, size_t size);
+void *shm_attach (int key, void *addr);
+bool shm_detach (void *addr);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
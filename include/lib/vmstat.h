@@ -0,0 +1,21 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+#include <stddef.h>
+
+/* Virtual memory counters of a process, kept by the kernel and returned
+ * to the user by vmstat(). */
+struct vmstat {
+	size_t minor_faults;    /* Faults served without reading the disk. */
+	size_t major_faults;    /* Faults that read a file or swap. */
+	size_t cow_faults;      /* Writes that copied a shared frame. */
+	size_t stack_faults;    /* Faults that grew the stack. */
+	size_t evicted;         /* Pages evicted from memory. */
+	size_t swapped_in;      /* Pages read back from swap. */
+	size_t rss;             /* Pages resident in memory. */
+	size_t swap_slots;      /* Swap slots referenced. */
+	size_t pt_pages;        /* Pages of page tables. */
+	size_t working_set;     /* Resident pages used in the last second. */
+};
+
+#endif /* lib/vmstat.h */
@@ -2,6 +2,7 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
@@ -10,13 +11,20 @@ typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
+bool pml4_for_each_table (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
+size_t pml4_table_cnt (uint64_t *pml4);
+void pml4_share_init (void);
+bool pml4_share_table (uint64_t *pml4, uint64_t *pde, void *va);
+void pml4_drop_shared (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_set_large_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
 void pml4_clear_page (uint64_t *pml4, void *upage);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
+bool pml4_is_shared (uint64_t *pml4, const void *upage);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
 
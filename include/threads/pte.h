@@ -26,7 +26,7 @@
 #define PDPE(la) ((((uint64_t) (la)) >> PDPESHIFT) & 0x1FF)
 #define PDX(la)  ((((uint64_t) (la)) >> PDXSHIFT) & 0x1FF)
 #define PTX(la)  ((((uint64_t) (la)) >> PTXSHIFT) & 0x1FF)
-#define PTE_ADDR(pte) ((uint64_t) (pte) & ~0xFFF)
+#define PTE_ADDR(pte) ((uint64_t) (pte) & PTE_ADDR_MASK)
 
 /* The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
@@ -34,12 +34,25 @@
    A PDE or PTE that is initialized to 0 will be interpreted as
    "not present", which is just fine. */
 #define PTE_FLAGS 0x00000000000000fffUL    /* Flag bits. */
-#define PTE_ADDR_MASK  0xffffffffffffff000UL /* Address bits. */
+#define PTE_ADDR_MASK  0x000ffffffffff000UL /* Address bits. */
 #define PTE_AVL   0x00000e00             /* Bits available for OS use. */
 #define PTE_P 0x1                        /* 1=present, 0=not present. */
 #define PTE_W 0x2                        /* 1=read/write, 0=read-only. */
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=large page (PDEs only). */
+#define PTE_SHARED 0x200                 /* 1=table shared by PML4s (PDEs only). */
+
+/* Bits 52-61 are ignored by the CPU in entries that point to a table. The
+ * kernel keeps the number of present entries of that table there. */
+#define PTE_CNT_SHIFT 52
+#define PTE_CNT_MASK (0x3ffUL << PTE_CNT_SHIFT)
+#define PTE_CNT(pte) (((uint64_t) (pte) & PTE_CNT_MASK) >> PTE_CNT_SHIFT)
+
+/* A PDE with PTE_PS maps a large page directly, without a page table. */
+#define LARGE_PGSIZE (1UL << PDXSHIFT)   /* Bytes in a large page. */
+#define LARGE_PGCNT (LARGE_PGSIZE / PGSIZE)  /* Pages in a large page. */
+#define LARGE_PTE_ADDR(pde) (PTE_ADDR (pde) & ~(LARGE_PGSIZE - 1))
 
 #endif /* threads/pte.h */
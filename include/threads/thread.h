@@ -8,6 +8,7 @@
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #ifdef VM
+#include <vmstat.h>
 #include "vm/vm.h"
 #endif
 
@@ -130,10 +131,20 @@ typedef struct thread {
     struct semaphore fork_sema;  // fork가 완료될 때 signal
     struct semaphore exit_sema;  // 자식 프로세스 종료 signal
     struct semaphore wait_sema;  // exit_sema를 기다릴 때 사용
+    struct thread *vfork_parent;  // vfork: 주소 공간을 빌려준 부모 (exec/exit 전까지)
 #endif
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	void *user_rsp;                     /* User rsp on entry to a syscall. */
+	struct list mmap_list;              /* Mappings made by mmap. */
+	struct list shm_list;               /* Shared memory attached. */
+	struct vmstat vmstat;               /* Memory counters since exec. */
+	size_t rss_limit;                   /* Most resident pages, or 0. */
+#endif
+#ifdef FILESYS
+	/* Owned by filesys/journal.c. */
+	int journal_depth;                  /* Journal operations begun. */
 #endif
 
 	/* Owned by thread.c. */
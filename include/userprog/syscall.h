@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include "filesys/off_t.h"
 typedef int pid_t;
 #define PID_ERROR ((pid_t) - 1)
 
@@ -11,10 +12,13 @@ void syscall_init (void);
 
 
 void check_address(void *addr);
-void halt_syscall();
+void halt_syscall(void);
 void exit_syscall(int status);
 pid_t fork_syscall(const char *thread_name);
 int exec_syscall(const char *cmd_line);
+struct spawn_action;
+pid_t spawn_syscall(const char *cmd_line, const struct spawn_action *actions);
+pid_t vfork_syscall(void);
 int wait_syscall(pid_t tid);
 bool create_syscall(const char *file, unsigned initial_size);
 bool remove_syscall(const char *file);
@@ -25,6 +29,18 @@ int write_syscall(int fd, const void *buffer, unsigned length);
 void seek_syscall(int fd, unsigned position);
 int tell_syscall(int fd);
 void close_syscall(int fd);
+#ifdef VM
+struct vmstat;
+void *mmap_syscall(void *addr, size_t length, int writable, int fd, off_t offset);
+void munmap_syscall(void *addr);
+int madvise_syscall(void *addr, size_t length, int advice);
+int msync_syscall(void *addr, size_t length);
+int vmstat_syscall(struct vmstat *st);
+size_t rss_limit_syscall(size_t page_cnt);
+bool shm_create_syscall(int key, size_t size);
+void *shm_attach_syscall(int key, void *addr);
+bool shm_detach_syscall(void *addr);
+#endif
 /** #Project 2: System Call */
 extern struct lock filesys_lock;  // 파일 읽기/쓰기 용 lock
 #endif /* userprog/syscall.h */
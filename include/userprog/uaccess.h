@@ -0,0 +1,24 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Accessors for user memory. They dereference user addresses directly
+ * instead of walking the page table first; a fault on a bad address is
+ * turned into an error return by the exception table below. */
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
+int strncpy_from_user (char *dst, const char *usrc, size_t size);
+
+/* An instruction allowed to fault on user memory, and where to resume
+ * when it does. */
+struct exception_entry {
+	uintptr_t insn;
+	uintptr_t fixup;
+};
+
+const struct exception_entry *search_exception_table (uintptr_t rip);
+
+#endif /* userprog/uaccess.h */
@@ -2,12 +2,23 @@
 #define VM_ANON_H
 #include "vm/vm.h"
 struct page;
+struct frame;
 enum vm_type;
 
+/* Swap slot of a page that is not in the swap disk. */
+#define SWAP_SLOT_NONE ((size_t) -1)
+
 struct anon_page {
+	size_t swap_slot;           /* Slot holding the contents, if swapped. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_share_swap (struct page *dst, struct page *src);
+
+size_t swap_write (const void *kva);
+size_t swap_write_frame (struct frame *frame);
+void swap_read (size_t slot, void *kva);
+void swap_slot_put (size_t slot);
 
 #endif
@@ -1,12 +1,27 @@
 #ifndef VM_FILE_H
 #define VM_FILE_H
+#include <list.h>
 #include "filesys/file.h"
 #include "vm/vm.h"
 
 struct page;
+struct vm_area;
 enum vm_type;
 
 struct file_page {
+	struct file *file;          /* Reopened file backing the mapping. */
+	off_t ofs;                  /* Offset of the page in FILE. */
+	size_t read_bytes;          /* Bytes of the page that come from FILE. */
+	size_t zero_bytes;          /* Bytes past the end of FILE. */
+};
+
+/* A region created by mmap. */
+struct mmap_file {
+	void *addr;                 /* First page of the mapping. */
+	size_t page_cnt;            /* Number of pages mapped. */
+	struct file *file;          /* Reopened file shared by all the pages. */
+	struct vm_area *area;       /* Area of the pages, holds a ref. */
+	struct list_elem elem;      /* Element in thread's mmap_list. */
 };
 
 void vm_file_init (void);
@@ -14,4 +29,6 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool do_madvise (void *addr, size_t length, int advice);
+bool do_msync (void *addr, size_t length);
 #endif
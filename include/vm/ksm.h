@@ -0,0 +1,17 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+#include <stddef.h>
+
+struct frame;
+
+/* Frames scanned per pass (-ksm=PAGES); 0 disables merging. */
+extern size_t ksm_pages_to_scan;
+/* Milliseconds between passes (-ksm-sleep=MS). */
+extern unsigned ksm_sleep_ms;
+
+void ksm_init (void);
+void ksm_forget (struct frame *frame);
+void ksm_note_unmerge (void);
+void ksm_print_stats (void);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+#include <list.h>
+#include <stddef.h>
+#include "vm/vm.h"
+
+struct page;
+struct frame;
+struct thread;
+
+/* A segment of anonymous memory that several processes map at once,
+ * found by its key. Page IDX of the segment is resident in FRAMES[IDX],
+ * swapped out to SLOTS[IDX], or was never touched. A frame in FRAMES that
+ * no page maps is kept by the segment, pinned. */
+struct shm_segment {
+	int key;                    /* Key given to shm_create(). */
+	size_t page_cnt;            /* Size in pages. */
+	int attach_cnt;             /* Number of attachments. */
+	int creator;                /* Tid of the process that created it. */
+	struct frame **frames;      /* Frame of each resident page. */
+	size_t *slots;              /* Swap slot of each swapped page. */
+	struct list_elem elem;      /* Element in the segment list. */
+};
+
+struct shm_page {
+	struct shm_segment *seg;    /* Segment the page belongs to. */
+	size_t idx;                 /* Page number within SEG. */
+};
+
+/* Where a process attached a segment. */
+struct shm_attachment {
+	void *addr;                 /* First page of the attachment. */
+	struct shm_segment *seg;    /* Segment attached, counted in it. */
+	struct list_elem elem;      /* Element in thread's shm_list. */
+};
+
+void vm_shm_init (void);
+bool shm_create (int key, size_t size);
+void *shm_attach (int key, void *addr);
+bool shm_detach (void *addr);
+void shm_detach_all (void);
+bool shm_fork (struct thread *parent);
+bool shm_overlaps (struct thread *t, void *addr, size_t size);
+struct frame *shm_frame (struct page *page);
+bool shm_page_swapped (struct page *page);
+
+#endif
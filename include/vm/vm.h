@@ -1,7 +1,13 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
+#include <list.h>
+#include <mman.h>
+#include "devices/disk.h"
+#include "filesys/off_t.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 
 enum vm_type {
 	/* page not initialized */
@@ -12,6 +18,8 @@ enum vm_type {
 	VM_FILE = 2,
 	/* page that hold the page cache, for project 4 */
 	VM_PAGE_CACHE = 3,
+	/* anonymous page shared between processes, see shm.c */
+	VM_SHM = 4,
 
 	/* Bit flags to store state */
 
@@ -24,9 +32,16 @@ enum vm_type {
 	VM_MARKER_END = (1 << 31),
 };
 
+/* Marks the pages of the user stack. */
+#define VM_STACK VM_MARKER_0
+
+/* Maximum size of the user stack. */
+#define STACK_LIMIT (1 << 20)
+
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/shm.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -46,6 +61,16 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct hash_elem spt_elem;     /* Element in the owner's spt. */
+	struct list_elem frame_elem;   /* Element in frame's mapping list. */
+	struct thread *owner;          /* Thread whose pml4 maps this page. */
+	bool writable;                 /* May the user write to this page? */
+	struct vm_area *area;          /* File region the page was loaded from. */
+	bool prefetched;               /* Mapped by fault-around, not used yet. */
+	struct list_elem resident_elem; /* Element in the owner's resident list. */
+	int64_t used_at;               /* Ticks when last seen accessed. */
+	bool referenced;               /* Accessed bit taken by a working set
+	                                  scan, not seen by the clock yet. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -53,16 +78,69 @@ struct page {
 		struct uninit_page uninit;
 		struct anon_page anon;
 		struct file_page file;
+		struct shm_page shm;
 #ifdef EFILESYS
 		struct page_cache page_cache;
 #endif
 	};
 };
 
-/* The representation of "frame" */
+/* Identifies the file contents of a page of executable text. */
+struct text_key {
+	disk_sector_t inode;           /* Sector of the executable's inode. */
+	off_t ofs;                     /* Offset of the page in the file. */
+	size_t read_bytes;             /* Bytes of the page read from the file. */
+};
+
+/* The representation of "frame".
+ * A frame is shared by several pages after fork (copy-on-write), so every
+ * page mapping it is linked in PAGES. PAGE is the page the frame was
+ * claimed for. */
 struct frame {
 	void *kva;
 	struct page *page;
+
+	struct list pages;             /* Pages mapping this frame. */
+	struct list_elem elem;         /* Element in the frame table. */
+	bool pinned;                   /* Must not be evicted right now. */
+	bool kept;                     /* Kept, pinned, by a shared memory
+	                                  segment with no page mapping it? */
+	bool writeback;                /* Written out by the reclaim daemon,
+	                                  without frame_lock, right now? */
+	size_t swap_slot;              /* Slot it was written to, for swap_out,
+	                                  or SWAP_SLOT_NONE. */
+
+	/* Same-page merging, see ksm.c. */
+	struct hash_elem ksm_elem;     /* Element in the stable table. */
+	uint64_t checksum;             /* Contents hash at the last scan. */
+	bool indexed;                  /* In the stable table? */
+	bool merged;                   /* Holds pages merged by ksm? */
+
+	/* Executable text shared between processes. */
+	struct hash_elem text_elem;    /* Element in the text cache. */
+	struct text_key text_key;      /* Contents of the frame. */
+	bool text;                     /* In the text cache? */
+};
+
+/* Largest fault-around window, in pages. */
+#define FAULT_AROUND_MAX 16
+
+/* A region of consecutive pages backed by consecutive parts of one file: a
+ * segment of an executable or an mmap region. */
+struct vm_area {
+	int advice;                    /* Expected access pattern, MADV_*. */
+	size_t fault_around;           /* Pages to map around a fault. */
+	int refs;                      /* References from pages. */
+};
+
+/* Where the contents of a lazily loaded page come from. */
+struct lazy_load_arg {
+	struct file *file;
+	off_t ofs;
+	size_t read_bytes;
+	size_t zero_bytes;
+	struct vm_area *area;          /* Region of the page, holds a ref. */
+	const void *preload;           /* Contents already read, if not NULL. */
 };
 
 /* The function table for page operations.
@@ -85,6 +163,9 @@ struct page_operations {
  * We don't want to force you to obey any specific design for this struct.
  * All designs up to you for this. */
 struct supplemental_page_table {
+	struct hash pages;
+	struct list resident;          /* Pages linked to a frame, in the order
+	                                  of the local clock. */
 };
 
 #include "threads/thread.h"
@@ -92,6 +173,7 @@ void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
 		struct supplemental_page_table *src);
 void supplemental_page_table_kill (struct supplemental_page_table *spt);
+void vm_fork_page_tables (struct thread *parent);
 struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
@@ -109,4 +191,32 @@ void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
 
+extern struct lock frame_lock;
+extern struct list frame_table;
+void vm_unmap_page (struct page *page);
+void vm_unmap_page_keep (struct page *page);
+void vm_free_frame (struct frame *frame);
+bool vm_page_is_dirty (struct page *page);
+bool vm_protect_frame (struct frame *frame);
+size_t vm_merge_frame (struct frame *dst, struct frame *src);
+
+/* Default fault-around window (-fault-around=PAGES). */
+extern size_t fault_around_pages;
+/* Print per-process memory counters at exit (-vm-stats)? */
+extern bool vm_stats_enabled;
+/* Back aligned anonymous regions with large pages (-large-pages)? */
+extern bool large_pages_enabled;
+/* Free user page watermarks of the reclaim daemon (-reclaim-low=PAGES,
+ * -reclaim-high=PAGES). It only runs if a low watermark is given. */
+extern size_t reclaim_low;
+extern size_t reclaim_high;
+struct vm_area *vm_area_create (void);
+struct vm_area *vm_area_get (struct vm_area *area);
+void vm_area_put (struct vm_area *area);
+void vm_area_advise (struct vm_area *area, int advice);
+void vm_populate (void *addr, size_t page_cnt);
+void vm_drop_pages (void *addr, size_t page_cnt);
+size_t vm_set_rss_limit (size_t page_cnt);
+size_t vm_working_set (void);
+
 #endif  /* VM_VM_H */
@@ -90,6 +90,26 @@ exec (const char *file) {
 	return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
+pid_t
+spawn (const char *file, const struct spawn_action *actions) {
+	return (pid_t) syscall2 (SYS_SPAWN, file, actions);
+}
+
+/* The child runs on our stack until it execs or exits, so the return
+   address must not stay there: a call the child makes would overwrite
+   it before we return. */
+__attribute__((naked))
+pid_t
+vfork (void) {
+	__asm __volatile(
+			"pop %%rdx\n"
+			"mov %0, %%eax\n"
+			"syscall\n"
+			"push %%rdx\n"
+			"ret\n"
+			: : "i" (SYS_VFORK));
+}
+
 int
 wait (pid_t pid) {
 	return syscall1 (SYS_WAIT, pid);
@@ -155,6 +175,46 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+int
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+msync (void *addr, size_t length) {
+	return syscall2 (SYS_MSYNC, addr, length);
+}
+
+int
+vmstat (struct vmstat *st) {
+	return syscall1 (SYS_VMSTAT, st);
+}
+
+int64_t
+ticks (void) {
+	return (int64_t) syscall0 (SYS_TICKS);
+}
+
+size_t
+rss_limit (size_t page_cnt) {
+	return syscall1 (SYS_RSS_LIMIT, page_cnt);
+}
+
+bool
+shm_create (int key, size_t size) {
+	return syscall2 (SYS_SHM_CREATE, key, size);
+}
+
+void *
+shm_attach (int key, void *addr) {
+	return (void *) syscall2 (SYS_SHM_ATTACH, key, addr);
+}
+
+bool
+shm_detach (void *addr) {
+	return syscall1 (SYS_SHM_DETACH, addr);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
@@ -0,0 +1,37 @@
+/* Writes out a file of the size grow-seq-lg grows to, then reads
+   it back sequentially a few times, one 512-byte block at a time.
+   The file spans more sectors than the buffer cache holds, so
+   every pass depends on reading ahead. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 72943
+#define PASS_CNT 4
+
+static const char file_name[] = "sequel";
+static char buf[TEST_SIZE];
+
+void
+test_main (void)
+{
+  int fd;
+  int i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+  for (i = 0; i < PASS_CNT; i++)
+    {
+      seek (fd, 0);
+      check_file_handle (fd, file_name, buf, sizeof buf);
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-seq-read) begin
+(lg-seq-read) create "sequel"
+(lg-seq-read) open "sequel"
+(lg-seq-read) write "sequel"
+(lg-seq-read) verified contents of "sequel"
+(lg-seq-read) verified contents of "sequel"
+(lg-seq-read) verified contents of "sequel"
+(lg-seq-read) verified contents of "sequel"
+(lg-seq-read) close "sequel"
+(lg-seq-read) end
+EOF
+pass;
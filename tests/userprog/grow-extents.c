@@ -0,0 +1,90 @@
+/* Grows two files a sector at a time, in turn, closing each after
+   every write so that its new sector gets disk space then.  Neither
+   file can extend its last extent in place, so each ends up with a
+   new extent per sector, more than fit in the inode, and the rest go
+   to indirect extent blocks.  Checks both read back, then removes one
+   and writes a new file as large into the sectors it freed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTOR 512
+#define SECTOR_CNT 80           /* More extents than the inode holds. */
+
+static char buf[SECTOR];
+
+/* Fills BUF with the contents of sector IDX of file ID. */
+static void
+fill (int id, int idx)
+{
+  memset (buf, 'a' + id * 8 + idx % 8, sizeof buf);
+  buf[0] = idx;
+}
+
+/* Appends sector IDX to file NAME, number ID. */
+static void
+append (const char *name, int id, int idx)
+{
+  int fd = open (name);
+
+  if (fd < 2)
+    fail ("open \"%s\" failed", name);
+  fill (id, idx);
+  seek (fd, idx * SECTOR);
+  if (write (fd, buf, SECTOR) != SECTOR)
+    fail ("write of sector %d of \"%s\" failed", idx, name);
+  close (fd);
+}
+
+/* Checks every sector of file NAME, number ID. */
+static void
+verify (const char *name, int id)
+{
+  char actual[SECTOR];
+  int fd, idx;
+
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  if (filesize (fd) != SECTOR_CNT * SECTOR)
+    fail ("\"%s\" is %d bytes, not %d", name, filesize (fd),
+          SECTOR_CNT * SECTOR);
+  for (idx = 0; idx < SECTOR_CNT; idx++)
+    {
+      fill (id, idx);
+      if (read (fd, actual, SECTOR) != SECTOR
+          || memcmp (actual, buf, SECTOR))
+        fail ("sector %d of \"%s\" reads back wrong", idx, name);
+    }
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  int fd, idx;
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  msg ("append %d sectors to each in turn", SECTOR_CNT);
+  for (idx = 0; idx < SECTOR_CNT; idx++)
+    {
+      append ("a", 0, idx);
+      append ("b", 1, idx);
+    }
+  verify ("a", 0);
+  verify ("b", 1);
+
+  CHECK (remove ("a"), "remove \"a\"");
+  CHECK (create ("c", 0), "create \"c\"");
+  CHECK ((fd = open ("c")) > 1, "open \"c\"");
+  for (idx = 0; idx < SECTOR_CNT; idx++)
+    {
+      fill (2, idx);
+      if (write (fd, buf, SECTOR) != SECTOR)
+        fail ("write of sector %d of \"c\" failed", idx);
+    }
+  close (fd);
+  verify ("c", 2);
+  verify ("b", 1);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(grow-extents) begin
+(grow-extents) create "a"
+(grow-extents) create "b"
+(grow-extents) append 80 sectors to each in turn
+(grow-extents) open "a"
+(grow-extents) open "b"
+(grow-extents) remove "a"
+(grow-extents) create "c"
+(grow-extents) open "c"
+(grow-extents) open "c"
+(grow-extents) open "b"
+(grow-extents) end
+grow-extents: exit(0)
+EOF
+pass;
@@ -0,0 +1,30 @@
+/* Spawns a child that gets an open file at another descriptor,
+   the original descriptor being closed in the child only, and
+   then spawns a program that does not exist. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  struct spawn_action actions[] = {
+    { handle, 7 },
+    { handle, SPAWN_CLOSE },
+    { -1, 0 },
+  };
+  pid_t pid = spawn ("child-close 7", actions);
+  if (pid == PID_ERROR)
+    fail ("spawn failed");
+  msg ("wait(spawn()) = %d", wait (pid));
+
+  check_file_handle (handle, "sample.txt", sample, sizeof sample - 1);
+
+  msg ("spawn(\"no-such-file\") = %d", spawn ("no-such-file", NULL));
+}
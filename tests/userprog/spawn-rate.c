@@ -0,0 +1,56 @@
+/* Starts CHILD_CNT children each by fork and exec, by vfork and
+   exec, and by spawn, waiting for each one, and prints the timer
+   ticks each method took.  Only the last two avoid copying the
+   address space of the parent, and should take fewer. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 10
+
+static void
+wait_child (pid_t pid) 
+{
+  int status;
+
+  if (pid == PID_ERROR)
+    fail ("could not create child");
+  if ((status = wait (pid)) != 81)
+    fail ("child exited with %d, not 81", status);
+}
+
+void
+test_main (void) 
+{
+  int64_t start;
+  int i;
+
+  start = ticks ();
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      pid_t pid = fork ("child-simple");
+      if (pid == 0)
+        exit (exec ("child-simple"));
+      wait_child (pid);
+    }
+  msg ("fork and exec: %d children in %lld ticks",
+       CHILD_CNT, (long long) (ticks () - start));
+
+  start = ticks ();
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      pid_t pid = vfork ();
+      if (pid == 0)
+        exit (exec ("child-simple"));
+      wait_child (pid);
+    }
+  msg ("vfork and exec: %d children in %lld ticks",
+       CHILD_CNT, (long long) (ticks () - start));
+
+  start = ticks ();
+  for (i = 0; i < CHILD_CNT; i++)
+    wait_child (spawn ("child-simple", NULL));
+  msg ("spawn: %d children in %lld ticks",
+       CHILD_CNT, (long long) (ticks () - start));
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The ticks each method took vary from run to run.
+s/children in \d+ ticks/children in N ticks/ foreach @output;
+
+my ($fork) = "(child-simple) run\nchild-simple: exit(81)\n" x 10;
+my ($vfork) = "(child-simple) run\nspawn-rate: exit(81)\n" x 10;
+compare_output ("run", \@output, ["(spawn-rate) begin\n"
+		 . $fork
+		 . "(spawn-rate) fork and exec: 10 children in N ticks\n"
+		 . $vfork
+		 . "(spawn-rate) vfork and exec: 10 children in N ticks\n"
+		 . $fork
+		 . "(spawn-rate) spawn: 10 children in N ticks\n"
+		 . "(spawn-rate) end\nspawn-rate: exit(0)\n"]);
+pass;
@@ -0,0 +1,26 @@
+/* Child process of rss-limit.
+   Writes every page of 4 MB, more than the user pool of the test
+   machine, then checks that it all reads back. */
+
+#include "tests/lib.h"
+
+const char *test_name = "child-hog";
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 1024
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+int
+main (int argc UNUSED, char *argv[] UNUSED)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i;
+  for (i = 0; i < PAGE_CNT; i++)
+    if (buf[i * PAGE_SIZE] != (char) i)
+      fail ("page %zu is inconsistent", i);
+
+  return 0x42;
+}
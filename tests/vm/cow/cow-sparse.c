@@ -0,0 +1,53 @@
+/* Forks children of a process with a large, sparsely touched
+   address space.  Each child reads every touched page, then
+   writes some of them; the parent must see none of the writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SPAN (8 * 1024 * 1024)
+#define STRIDE (64 * 1024)
+#define CHILD_CNT 3
+
+static char sparse[SPAN];
+
+static void
+check_pages (int writer)
+{
+  size_t ofs;
+
+  for (ofs = 0; ofs < SPAN; ofs += STRIDE)
+    if (sparse[ofs] != (char) (ofs / STRIDE))
+      fail ("byte at offset %zu is %d after write by %d",
+            ofs, sparse[ofs], writer);
+}
+
+void
+test_main (void)
+{
+  size_t ofs;
+  int i;
+
+  for (ofs = 0; ofs < SPAN; ofs += STRIDE)
+    sparse[ofs] = ofs / STRIDE;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      pid_t child = fork ("child");
+      if (child == 0)
+        {
+          check_pages (-1);
+          for (ofs = i * STRIDE; ofs < SPAN; ofs += CHILD_CNT * STRIDE)
+            sparse[ofs] = -1;
+          exit (i);
+        }
+      if (wait (child) != i)
+        fail ("child %d failed", i);
+      check_pages (i);
+    }
+  msg ("parent unaffected by %d children", CHILD_CNT);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-sparse) begin
+(cow-sparse) parent unaffected by 3 children
+(cow-sparse) end
+EOF
+pass;
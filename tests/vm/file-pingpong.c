@@ -0,0 +1,77 @@
+/* A child process produces blocks into a ring in a file and the parent
+   consumes them, polling counters kept in the first block of the file.
+   This is the baseline that shm-pingpong is measured against. */
+
+#include <syscall.h>
+#include "tests/vm/pingpong.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Offsets of the counters in the first block of the file. */
+#define HEAD_OFS 0              /* Blocks produced. */
+#define TAIL_OFS 8              /* Blocks consumed. */
+
+static unsigned char block[BLOCK_SIZE];
+
+static size_t
+get_counter (int fd, unsigned ofs)
+{
+  size_t value;
+
+  seek (fd, ofs);
+  if (read (fd, &value, sizeof value) != sizeof value)
+    fail ("read counter");
+  return value;
+}
+
+static void
+set_counter (int fd, unsigned ofs, size_t value)
+{
+  seek (fd, ofs);
+  if (write (fd, &value, sizeof value) != sizeof value)
+    fail ("write counter");
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+  int fd;
+
+  CHECK (create ("pingpong.dat", (RING_SLOTS + 1) * BLOCK_SIZE),
+         "create \"pingpong.dat\"");
+
+  child = fork ("producer");
+  if (child == 0)
+    {
+      if ((fd = open ("pingpong.dat")) < 2)
+        fail ("open \"pingpong.dat\"");
+      for (i = 0; i < BLOCK_CNT; i++)
+        {
+          while (i - get_counter (fd, TAIL_OFS) == RING_SLOTS)
+            continue;
+          fill_block (block, i);
+          seek (fd, (1 + i % RING_SLOTS) * BLOCK_SIZE);
+          if (write (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+            fail ("write block %zu", i);
+          set_counter (fd, HEAD_OFS, i + 1);
+        }
+      exit (0);
+    }
+
+  CHECK ((fd = open ("pingpong.dat")) > 1, "open \"pingpong.dat\"");
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      while (get_counter (fd, HEAD_OFS) == i)
+        continue;
+      seek (fd, (1 + i % RING_SLOTS) * BLOCK_SIZE);
+      if (read (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("read block %zu", i);
+      check_block (block, i);
+      set_counter (fd, TAIL_OFS, i + 1);
+    }
+  CHECK (wait (child) == 0, "wait for producer");
+  msg ("received %d blocks", BLOCK_CNT);
+  close (fd);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(file-pingpong) begin
+(file-pingpong) create "pingpong.dat"
+(file-pingpong) open "pingpong.dat"
+(file-pingpong) wait for producer
+(file-pingpong) received 128 blocks
+(file-pingpong) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Maps a file with MAP_POPULATE, gives every kind of advice on the
+   mapping and checks that the data survives, including a write that
+   must be written back before MADV_DONTNEED drops the page.  The page
+   must be resident right after MAP_POPULATE and MADV_WILLNEED, without
+   waiting for a fault. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  struct vmstat before, after;
+  int handle, advised;
+  void *map;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  vmstat (&before);
+  map = mmap (actual, 4096, 1 | MAP_POPULATE, handle, 0);
+  vmstat (&after);
+  CHECK (map != MAP_FAILED, "mmap \"sample.txt\" with MAP_POPULATE");
+  CHECK (after.rss == before.rss + 1, "page resident after MAP_POPULATE");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of populated mapping reported bad data");
+
+  CHECK (madvise (actual, 4096, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  CHECK (madvise (actual, 4096, MADV_RANDOM) == 0, "madvise random");
+
+  actual[0] = 'X';
+  CHECK (madvise (actual, 4096, MADV_DONTNEED) == 0, "madvise dontneed");
+
+  vmstat (&before);
+  advised = madvise (actual, 4096, MADV_WILLNEED);
+  vmstat (&after);
+  CHECK (advised == 0, "madvise willneed");
+  CHECK (after.rss == before.rss + 1, "page resident after MADV_WILLNEED");
+  if (actual[0] != 'X' || memcmp (actual + 1, sample + 1, strlen (sample) - 1))
+    fail ("mapping lost data after MADV_DONTNEED");
+
+  CHECK (madvise (actual + 4096, 4096, MADV_WILLNEED) == -1,
+         "madvise outside the mapping");
+
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-madvise) begin
+(mmap-madvise) open "sample.txt"
+(mmap-madvise) mmap "sample.txt" with MAP_POPULATE
+(mmap-madvise) page resident after MAP_POPULATE
+(mmap-madvise) madvise sequential
+(mmap-madvise) madvise random
+(mmap-madvise) madvise dontneed
+(mmap-madvise) madvise willneed
+(mmap-madvise) page resident after MADV_WILLNEED
+(mmap-madvise) madvise outside the mapping
+(mmap-madvise) end
+EOF
+pass;
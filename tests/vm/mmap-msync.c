@@ -0,0 +1,33 @@
+/* Writes to a file through a mapping and checks that msync makes the
+   change visible to read() before the mapping goes away. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  static const char overwrite[] = "msync was here";
+  char buf[sizeof overwrite];
+  int handle;
+  void *map;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (actual, 4096, 1, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  memcpy (actual, overwrite, strlen (overwrite));
+  CHECK (msync (actual, 4096) == 0, "msync \"sample.txt\"");
+
+  CHECK (read (handle, buf, strlen (overwrite)) == (int) strlen (overwrite),
+         "read \"sample.txt\"");
+  if (memcmp (buf, overwrite, strlen (overwrite)))
+    fail ("file does not hold the data written through the mapping");
+
+  CHECK (msync (actual + 4096, 4096) == -1, "msync outside the mapping");
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,25 @@
+#include "tests/vm/pingpong.h"
+#include "tests/lib.h"
+
+/* Fills BLOCK with the contents of block IDX. */
+void
+fill_block (void *block, size_t idx)
+{
+  unsigned char *p = block;
+  size_t i;
+
+  for (i = 0; i < BLOCK_SIZE; i++)
+    p[i] = idx * 31 + i;
+}
+
+/* Fails unless BLOCK holds the contents of block IDX. */
+void
+check_block (const void *block, size_t idx)
+{
+  const unsigned char *p = block;
+  size_t i;
+
+  for (i = 0; i < BLOCK_SIZE; i++)
+    if (p[i] != (unsigned char) (idx * 31 + i))
+      fail ("block %zu corrupted at byte %zu", idx, i);
+}
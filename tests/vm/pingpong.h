@@ -0,0 +1,18 @@
+#ifndef TESTS_VM_PINGPONG
+#define TESTS_VM_PINGPONG 1
+
+#include <stddef.h>
+
+/* A producer passes BLOCK_CNT blocks to a consumer through a ring of
+   RING_SLOTS blocks. */
+#define BLOCK_SIZE 4096
+#define BLOCK_CNT 128
+#define RING_SLOTS 4
+
+/* Keeps the compiler from moving memory accesses across it. */
+#define barrier() asm volatile ("" : : : "memory")
+
+void fill_block (void *block, size_t idx);
+void check_block (const void *block, size_t idx);
+
+#endif /* tests/vm/pingpong.h */
@@ -0,0 +1,66 @@
+/* Checks that a process at its resident limit evicts its own pages,
+   and that a memory hog held to a limit set before exec leaves the
+   pages of other processes alone. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define OWN_LIMIT 16
+#define OWN_PAGES 64
+#define SMALL_PAGES 16
+#define HOG_LIMIT 64
+
+static char own[OWN_PAGES * PAGE_SIZE];
+static char small[SMALL_PAGES * PAGE_SIZE];
+
+static void
+check_small (void)
+{
+  size_t i;
+
+  for (i = 0; i < SMALL_PAGES; i++)
+    if (small[i * PAGE_SIZE] != (char) i)
+      fail ("page %zu of the small process is inconsistent", i);
+}
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+  pid_t hog;
+  size_t i;
+
+  /* Page against ourselves. */
+  CHECK (rss_limit (OWN_LIMIT) == 0, "set limit of %d pages", OWN_LIMIT);
+  CHECK (vmstat (&before) == 0, "vmstat");
+  for (i = 0; i < OWN_PAGES; i++)
+    own[i * PAGE_SIZE] = i;
+  CHECK (vmstat (&after) == 0, "vmstat");
+  if (after.evicted - before.evicted < OWN_PAGES - OWN_LIMIT)
+    fail ("only %zu pages evicted", after.evicted - before.evicted);
+  for (i = 0; i < OWN_PAGES; i++)
+    if (own[i * PAGE_SIZE] != (char) i)
+      fail ("page %zu is inconsistent", i);
+  CHECK (rss_limit (0) == OWN_LIMIT, "lift limit");
+
+  /* Run a hog limited at exec next to a small working set. */
+  for (i = 0; i < SMALL_PAGES; i++)
+    small[i * PAGE_SIZE] = i;
+  CHECK (vmstat (&before) == 0, "vmstat");
+  hog = fork ("hog");
+  if (hog == 0)
+    {
+      rss_limit (HOG_LIMIT);
+      exec ("child-hog");
+      fail ("exec child-hog");
+    }
+  CHECK (wait (hog) == 0x42, "wait for hog");
+  check_small ();
+  CHECK (vmstat (&after) == 0, "vmstat");
+  if (after.evicted != before.evicted)
+    fail ("small process lost %zu pages to the hog",
+          after.evicted - before.evicted);
+  msg ("small process kept its pages");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rss-limit) begin
+(rss-limit) set limit of 16 pages
+(rss-limit) vmstat
+(rss-limit) vmstat
+(rss-limit) lift limit
+(rss-limit) vmstat
+(rss-limit) wait for hog
+(rss-limit) vmstat
+(rss-limit) small process kept its pages
+(rss-limit) end
+EOF
+pass;
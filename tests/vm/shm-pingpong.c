@@ -0,0 +1,59 @@
+/* A child process produces blocks into a ring in a shared memory segment
+   and the parent consumes them. file-pingpong passes the same blocks
+   through a file; comparing the ticks and disk accesses the kernel reports
+   for the two tests measures the cost of each exchange. */
+
+#include <syscall.h>
+#include "tests/vm/pingpong.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define KEY 0x5eed
+
+/* First page of the segment; the ring of blocks follows it. */
+struct ring
+  {
+    volatile size_t head;       /* Blocks produced. */
+    volatile size_t tail;       /* Blocks consumed. */
+  };
+
+void
+test_main (void)
+{
+  struct ring *ring = (struct ring *) 0x10000000;
+  unsigned char *slots = (unsigned char *) ring + BLOCK_SIZE;
+  pid_t child;
+  size_t i;
+
+  CHECK (shm_create (KEY, (RING_SLOTS + 1) * BLOCK_SIZE), "create segment");
+  CHECK (shm_attach (KEY, ring) == ring, "attach segment");
+
+  child = fork ("producer");
+  if (child == 0)
+    {
+      /* The child inherits the attachment. */
+      for (i = 0; i < BLOCK_CNT; i++)
+        {
+          while (ring->head - ring->tail == RING_SLOTS)
+            continue;
+          fill_block (slots + i % RING_SLOTS * BLOCK_SIZE, i);
+          barrier ();
+          ring->head = i + 1;
+        }
+      exit (0);
+    }
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      while (ring->head == i)
+        continue;
+      barrier ();
+      check_block (slots + i % RING_SLOTS * BLOCK_SIZE, i);
+      ring->tail = i + 1;
+    }
+  CHECK (wait (child) == 0, "wait for producer");
+  msg ("received %d blocks", BLOCK_CNT);
+
+  CHECK (shm_detach (ring), "detach segment");
+  CHECK (shm_attach (KEY, ring) == NULL, "segment freed with last detach");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(shm-pingpong) begin
+(shm-pingpong) create segment
+(shm-pingpong) attach segment
+(shm-pingpong) wait for producer
+(shm-pingpong) received 128 blocks
+(shm-pingpong) detach segment
+(shm-pingpong) segment freed with last detach
+(shm-pingpong) end
+EOF
+pass;
@@ -0,0 +1,29 @@
+/* Touches pages of a large uninitialized array and checks that the
+   process's memory counters account for them. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 16
+
+static char buf[PAGE_CNT * 4096];
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+  size_t i;
+
+  CHECK (vmstat (&before) == 0, "vmstat");
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * 4096] = 1;
+  CHECK (vmstat (&after) == 0, "vmstat");
+
+  if (after.rss < before.rss + PAGE_CNT)
+    fail ("rss grew by %zu pages, expected at least %d",
+          after.rss - before.rss, PAGE_CNT);
+  if (after.minor_faults + after.major_faults
+      < before.minor_faults + before.major_faults + PAGE_CNT)
+    fail ("too few page faults counted");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(vmstat) begin
+(vmstat) vmstat
+(vmstat) vmstat
+(vmstat) end
+EOF
+pass;
@@ -31,11 +31,15 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/ksm.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/buffer-cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -216,6 +220,8 @@ parse_options (char **argv) {
 #ifdef FILESYS
 		else if (!strcmp (name, "-f"))
 			format_filesys = true;
+		else if (!strcmp (name, "-eager-alloc"))
+			inode_delay_alloc = false;
 #endif
 		else if (!strcmp (name, "-rs"))
 			random_init (atoi (value));
@@ -226,6 +232,22 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-ksm"))
+			ksm_pages_to_scan = atoi (value);
+		else if (!strcmp (name, "-ksm-sleep"))
+			ksm_sleep_ms = atoi (value);
+		else if (!strcmp (name, "-fault-around"))
+			fault_around_pages = atoi (value);
+		else if (!strcmp (name, "-vm-stats"))
+			vm_stats_enabled = true;
+		else if (!strcmp (name, "-reclaim-low"))
+			reclaim_low = atoi (value);
+		else if (!strcmp (name, "-reclaim-high"))
+			reclaim_high = atoi (value);
+		else if (!strcmp (name, "-large-pages"))
+			large_pages_enabled = true;
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -324,10 +346,23 @@ usage (void) {
 			"  -h                 Print this help message and power off.\n"
 			"  -q                 Power off VM after actions or on panic.\n"
 			"  -f                 Format file system disk during startup.\n"
+#ifdef FILESYS
+			"  -eager-alloc       Allocate file sectors as soon as written.\n"
+#endif
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -ksm=PAGES         Merge identical pages, scanning PAGES per pass.\n"
+			"  -ksm-sleep=MS      Sleep MS milliseconds between merge passes.\n"
+			"  -fault-around=PAGES Map up to PAGES file pages per fault.\n"
+			"  -vm-stats          Print memory counters at process exit.\n"
+			"  -reclaim-low=PAGES Reclaim in the background below PAGES free.\n"
+			"  -reclaim-high=PAGES Stop background reclaim at PAGES free\n"
+			"                     (default: twice -reclaim-low).\n"
+			"  -large-pages       Map aligned 2 MB anonymous regions as large pages.\n"
 #endif
 			);
 	power_off ();
@@ -356,10 +391,15 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	journal_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	ksm_print_stats ();
+#endif
 }
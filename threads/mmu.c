@@ -1,58 +1,238 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <hash.h>
 #include "threads/init.h"
 #include "threads/pte.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
-static uint64_t *
-pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
-	int idx = PDX (va);
-	if (pdp) {
-		uint64_t *pte = (uint64_t *) pdp[idx];
-		if (!((uint64_t) pte & PTE_P)) {
-			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
-				if (new_page)
-					pdp[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
-				else
-					return NULL;
-			} else
-				return NULL;
-		}
-		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
+/* Levels of the page table tree: a PML4E, PDPTE, PDE or PTE. */
+#define PT_LEVELS 4
+static const unsigned level_shift[PT_LEVELS] = {
+	PML4SHIFT, PDPESHIFT, PDXSHIFT, PTXSHIFT
+};
+
+/* Every page directory pointer table, page directory and page table of
+ * an address space counts its present entries in the PTE_CNT bits of the
+ * entry that points to it, so that it is freed as soon as its last entry
+ * is cleared. The PML4 itself is not counted. */
+
+/* Adds DELTA to the count of present entries kept in ENTRY. */
+static void
+table_cnt_add (uint64_t *entry, int delta) {
+	uint64_t cnt = PTE_CNT (*entry) + delta;
+
+	ASSERT (cnt <= PGSIZE / sizeof (uint64_t));
+	*entry = (*entry & ~PTE_CNT_MASK) | (cnt << PTE_CNT_SHIFT);
+}
+
+/* Frees the tables on PATH, from the one holding PATH[LEVEL] up, that
+ * hold no present entries. */
+static void
+free_empty_tables (uint64_t *path[PT_LEVELS], int level) {
+	for (; level > 0; level--) {
+		uint64_t *entry = path[level - 1];
+
+		if (PTE_CNT (*entry) > 0)
+			break;
+		palloc_free_page (ptov (PTE_ADDR (*entry)));
+		*entry = 0;
+		if (level > 1)
+			table_cnt_add (path[level - 2], -1);
 	}
-	return NULL;
 }
 
-static uint64_t *
-pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
-	uint64_t *pte = NULL;
-	int idx = PDPE (va);
-	int allocated = 0;
-	if (pdpe) {
-		uint64_t *pde = (uint64_t *) pdpe[idx];
-		if (!((uint64_t) pde & PTE_P)) {
-			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
-				if (new_page) {
-					pdpe[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
-					allocated = 1;
-				} else
-					return NULL;
-			} else
-				return NULL;
-		}
-		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create);
+/* A page table that PDEs of several address spaces point to, each with
+ * PTE_SHARED set, as fork leaves it. Its entries are never changed in
+ * place: an address space that needs to change one first gets a copy of
+ * the table, unless it is the last one left. Reading the entries and the
+ * accessed bits the CPU sets in them do not matter. */
+struct shared_table {
+	uint64_t *pt;               /* Kernel virtual address of the table. */
+	unsigned refs;              /* Number of PDEs pointing to it. */
+	struct hash_elem elem;      /* Element in shared_tables. */
+};
+
+/* Shared page tables, by address. */
+static struct hash shared_tables;
+static struct lock shared_lock;
+
+static uint64_t
+shared_table_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct shared_table *st = hash_entry (e, struct shared_table, elem);
+	return hash_bytes (&st->pt, sizeof st->pt);
+}
+
+static bool
+shared_table_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct shared_table, elem)->pt
+		< hash_entry (b, struct shared_table, elem)->pt;
+}
+
+/* Initializes the bookkeeping of shared page tables. */
+void
+pml4_share_init (void) {
+	hash_init (&shared_tables, shared_table_hash, shared_table_less, NULL);
+	lock_init (&shared_lock);
+}
+
+/* Returns the bookkeeping of the table PDE points to, or NULL if the
+ * table is not shared yet. */
+static struct shared_table *
+find_shared (uint64_t *pde) {
+	struct shared_table key;
+	struct hash_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&shared_lock));
+
+	key.pt = ptov (PTE_ADDR (*pde));
+	e = hash_find (&shared_tables, &key.elem);
+	return e != NULL ? hash_entry (e, struct shared_table, elem) : NULL;
+}
+
+/* Drops the reference of shared PDE to its table, freeing the table
+ * with the last reference. */
+static void
+release_table (uint64_t *pde) {
+	struct shared_table *st;
+
+	lock_acquire (&shared_lock);
+	st = find_shared (pde);
+	ASSERT (st != NULL);
+	if (--st->refs == 0) {
+		hash_delete (&shared_tables, &st->elem);
+		palloc_free_page (st->pt);
+		free (st);
 	}
-	if (pte == NULL && allocated) {
-		palloc_free_page ((void *) ptov (PTE_ADDR (pdpe[idx])));
-		pdpe[idx] = 0;
+	lock_release (&shared_lock);
+}
+
+/* Gives shared PDE of PML4 a table of its own with the same entries, so
+ * that they can be changed. Returns false if memory allocation
+ * failed. */
+static bool
+unshare_table (uint64_t *pml4, uint64_t *pde) {
+	struct shared_table *st;
+	bool success = true;
+
+	lock_acquire (&shared_lock);
+	st = find_shared (pde);
+	ASSERT (st != NULL);
+	if (st->refs == 1) {
+		/* The other address spaces let go of it already. */
+		hash_delete (&shared_tables, &st->elem);
+		free (st);
+	} else {
+		uint64_t *pt = palloc_get_page (0);
+
+		if (pt != NULL) {
+			memcpy (pt, st->pt, PGSIZE);
+			st->refs--;
+			*pde = (*pde & ~PTE_ADDR_MASK) | vtop (pt);
+		} else
+			success = false;
+	}
+	if (success) {
+		*pde &= ~PTE_SHARED;
+		if (rcr3 () == vtop (pml4))
+			lcr3 (vtop (pml4));
 	}
-	return pte;
+	lock_release (&shared_lock);
+	return success;
+}
+
+/* Removes shared page table PATH[2] from its address space, with all the
+ * mappings in it, and frees the tables that become empty. The caller
+ * flushes the TLB. */
+static void
+drop_table (uint64_t *path[PT_LEVELS]) {
+	release_table (path[2]);
+	*path[2] = 0;
+	table_cnt_add (path[1], -1);
+	free_empty_tables (path, 2);
+}
+
+/* Replaces large page PDE, which maps VA, by a page table mapping the same
+ * frames with the same permissions. Returns false if memory allocation
+ * failed. */
+static bool
+split_large_page (uint64_t *pde, const uint64_t va) {
+	uint64_t *pt = palloc_get_page (0);
+	uint64_t flags = *pde & (PTE_P | PTE_W | PTE_U | PTE_A | PTE_D);
+
+	if (pt == NULL)
+		return false;
+	for (unsigned i = 0; i < LARGE_PGCNT; i++)
+		pt[i] = (LARGE_PTE_ADDR (*pde) + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P
+		| ((uint64_t) LARGE_PGCNT << PTE_CNT_SHIFT);
+	invlpg (va);
+	return true;
+}
+
+/* Walks PML4 down to the leaf entry for VA, storing the entry used at
+ * each level in PATH, and returns the level of the leaf: 3 for a PTE, or
+ * 2 for the PDE of a large page. Leaf PTEs never set bit 7 (PAT), so
+ * PTE_PS tells a large page apart.
+ * If CREATE, missing tables are allocated, a large page is split so that
+ * a PTE is returned, and a shared page table is copied so that the PTE
+ * may be changed. Returns -1 if a table is missing or cannot be
+ * allocated. */
+static int
+walk (uint64_t *pml4, const uint64_t va, int create,
+		uint64_t *path[PT_LEVELS]) {
+	uint64_t *table = pml4;
+	int level;
+
+	for (level = 0; ; level++) {
+		uint64_t *entry = &table[(va >> level_shift[level]) & 0x1FF];
+
+		path[level] = entry;
+		if (level == PT_LEVELS - 1)
+			return level;
+
+		if ((*entry & PTE_P) && (*entry & PTE_PS)) {
+			if (!create)
+				return level;
+			if (!split_large_page (entry, va))
+				break;
+		}
+		if (create && (*entry & PTE_SHARED) && !unshare_table (pml4, entry))
+			break;
+		if (!(*entry & PTE_P)) {
+			uint64_t *new_page;
+
+			if (!create || (new_page = palloc_get_page (PAL_ZERO)) == NULL)
+				break;
+			*entry = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+			if (level > 0)
+				table_cnt_add (path[level - 1], 1);
+		}
+		table = ptov (PTE_ADDR (*entry));
+	}
+
+	/* Do not keep the tables made on the way. */
+	if (create)
+		free_empty_tables (path, level);
+	return -1;
+}
+
+/* Marks leaf PATH[LEVEL] of VA in PML4 "not present", freeing the tables
+ * that become empty. */
+static void
+clear_entry (uint64_t *pml4, uint64_t *path[PT_LEVELS], int level,
+		const uint64_t va) {
+	*path[level] &= ~PTE_P;
+	if (rcr3 () == vtop (pml4))
+		invlpg (va);
+	table_cnt_add (path[level - 1], -1);
+	free_empty_tables (path, level);
 }
 
 /* Returns the address of the page table entry for virtual
@@ -60,32 +240,19 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.
+ * Without CREATE, the PDE of a large page mapping VADDR is
+ * returned.  Making a user PTE present through the pointer
+ * returned escapes the table counts; use pml4_set_page (). */
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
-	uint64_t *pte = NULL;
-	int idx = PML4 (va);
-	int allocated = 0;
-	if (pml4e) {
-		uint64_t *pdpe = (uint64_t *) pml4e[idx];
-		if (!((uint64_t) pdpe & PTE_P)) {
-			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
-				if (new_page) {
-					pml4e[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
-					allocated = 1;
-				} else
-					return NULL;
-			} else
-				return NULL;
-		}
-		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), va, create);
-	}
-	if (pte == NULL && allocated) {
-		palloc_free_page ((void *) ptov (PTE_ADDR (pml4e[idx])));
-		pml4e[idx] = 0;
-	}
-	return pte;
+	uint64_t *path[PT_LEVELS];
+	int level;
+
+	if (pml4e == NULL)
+		return NULL;
+	level = walk (pml4e, va, create, path);
+	return level >= 0 ? path[level] : NULL;
 }
 
 /* Creates a new page map level 4 (pml4) has mappings for kernel
@@ -122,7 +289,7 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if ((((uint64_t) pte) & PTE_P) && !(pdp[i] & PTE_PS))
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -155,6 +322,32 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	return true;
 }
 
+/* Applies FUNC to each present entry of the page directories in the
+ * user part of PML4, that is to each page table or large page, with the
+ * first virtual address it maps. */
+bool
+pml4_for_each_table (uint64_t *pml4, pte_for_each_func *func, void *aux) {
+	uint64_t *pdpt;
+
+	if (!(pml4[0] & PTE_P))
+		return true;
+	pdpt = ptov (PTE_ADDR (pml4[0]));
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++) {
+		uint64_t *pd;
+
+		if (!(pdpt[i] & PTE_P))
+			continue;
+		pd = ptov (PTE_ADDR (pdpt[i]));
+		for (unsigned j = 0; j < PGSIZE / sizeof (uint64_t); j++) {
+			void *va = (void *) (((uint64_t) i << PDPESHIFT)
+					| ((uint64_t) j << PDXSHIFT));
+			if ((pd[j] & PTE_P) && !func (&pd[j], va, aux))
+				return false;
+		}
+	}
+	return true;
+}
+
 static void
 pt_destroy (uint64_t *pt) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
@@ -169,8 +362,13 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			pt_destroy (PTE_ADDR (pte));
+		/* The frames of a large page belong to the VM. */
+		if ((((uint64_t) pte) & PTE_P) && !(pdp[i] & PTE_PS)) {
+			if (pdp[i] & PTE_SHARED)
+				release_table (&pdp[i]);
+			else
+				pt_destroy (PTE_ADDR (pte));
+		}
 	}
 	palloc_free_page ((void *) pdp);
 }
@@ -199,6 +397,109 @@ pml4_destroy (uint64_t *pml4) {
 	palloc_free_page ((void *) pml4);
 }
 
+/* Makes PML4 map the LARGE_PGSIZE bytes at VA with the page table that
+ * PDE of another address space points to, instead of copying its
+ * entries. The table is copied only once either side needs to change
+ * an entry. Returns false if PDE maps a large page, PML4 maps something
+ * there already, or memory allocation failed. */
+bool
+pml4_share_table (uint64_t *pml4, uint64_t *pde, void *va) {
+	uint64_t *path[PT_LEVELS];
+	struct shared_table *st;
+	bool success = false;
+
+	ASSERT ((uint64_t) va % LARGE_PGSIZE == 0);
+	ASSERT (*pde & PTE_P);
+
+	if (*pde & PTE_PS)
+		return false;
+
+	/* Make sure the page directory for VA exists, then replace the page
+	 * table there if it maps nothing. */
+	if (walk (pml4, (uint64_t) va, 1, path) != PT_LEVELS - 1)
+		return false;
+	if (PTE_CNT (*path[2]) > 0)
+		return false;
+
+	lock_acquire (&shared_lock);
+	st = find_shared (pde);
+	if (st == NULL && (st = malloc (sizeof *st)) != NULL) {
+		st->pt = ptov (PTE_ADDR (*pde));
+		st->refs = 1;
+		hash_insert (&shared_tables, &st->elem);
+	}
+	if (st != NULL) {
+		st->refs++;
+		palloc_free_page (ptov (PTE_ADDR (*path[2])));
+		*pde |= PTE_SHARED;
+		*path[2] = *pde;
+		success = true;
+	}
+	lock_release (&shared_lock);
+
+	if (!success)
+		free_empty_tables (path, PT_LEVELS - 1);
+	else if (rcr3 () == vtop (pml4))
+		lcr3 (vtop (pml4));
+	return success;
+}
+
+/* Removes every shared page table from PML4, which is about to go away,
+ * so that unmapping its pages one by one does not copy them. */
+void
+pml4_drop_shared (uint64_t *pml4) {
+	uint64_t *path[PT_LEVELS];
+	uint64_t *pdpt;
+
+	if (!(pml4[0] & PTE_P))
+		return;
+	path[0] = &pml4[0];
+	pdpt = ptov (PTE_ADDR (pml4[0]));
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++) {
+		uint64_t *pd;
+
+		if (!(pdpt[i] & PTE_P))
+			continue;
+		path[1] = &pdpt[i];
+		pd = ptov (PTE_ADDR (pdpt[i]));
+		/* Dropping the last table frees the directories above it. */
+		for (unsigned j = 0; j < PGSIZE / sizeof (uint64_t)
+				&& (pml4[0] & PTE_P) && (pdpt[i] & PTE_P); j++) {
+			if ((pd[j] & PTE_P) && (pd[j] & PTE_SHARED)) {
+				path[2] = &pd[j];
+				drop_table (path);
+			}
+		}
+		if (!(pml4[0] & PTE_P))
+			break;
+	}
+	if (rcr3 () == vtop (pml4))
+		lcr3 (vtop (pml4));
+}
+
+/* Returns the number of pages holding the page tables of the user
+ * part of PML4, PML4 included. */
+size_t
+pml4_table_cnt (uint64_t *pml4) {
+	size_t cnt = 1;
+	uint64_t *pdpt;
+
+	if (!(pml4[0] & PTE_P))
+		return cnt;
+	pdpt = ptov (PTE_ADDR (pml4[0]));
+	cnt++;
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++) {
+		if (pdpt[i] & PTE_P) {
+			uint64_t *pd = ptov (PTE_ADDR (pdpt[i]));
+			cnt++;
+			for (unsigned j = 0; j < PGSIZE / sizeof (uint64_t); j++)
+				if ((pd[j] & PTE_P) && !(pd[j] & PTE_PS))
+					cnt++;
+		}
+	}
+	return cnt;
+}
+
 /* Loads page directory PD into the CPU's page directory base
  * register. */
 void
@@ -216,6 +517,9 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
+	if (pte && (*pte & PTE_P) && (*pte & PTE_PS))
+		return ptov (LARGE_PTE_ADDR (*pte))
+			+ ((uint64_t) uaddr & (LARGE_PGSIZE - 1));
 	if (pte && (*pte & PTE_P))
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
 	return NULL;
@@ -223,8 +527,8 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 /* Adds a mapping in page map level 4 PML4 from user virtual page
  * UPAGE to the physical frame identified by kernel virtual address KPAGE.
- * UPAGE must not already be mapped. KPAGE should probably be a page obtained
- * from the user pool with palloc_get_page().
+ * A mapping UPAGE already has is replaced. KPAGE should probably be a
+ * page obtained from the user pool with palloc_get_page().
  * If WRITABLE is true, the new page is read/write;
  * otherwise it is read-only.
  * Returns true if successful, false if memory allocation
@@ -236,30 +540,110 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	ASSERT (is_user_vaddr (upage));
 	ASSERT (pml4 != base_pml4);
 
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
+	uint64_t *path[PT_LEVELS];
+	uint64_t pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	int level = walk (pml4, (uint64_t) upage, 0, path);
+
+	/* Leave an equal mapping alone, so that a shared table stays
+	 * shared. */
+	if (level == PT_LEVELS - 1
+			&& (*path[level] & ~(uint64_t) (PTE_A | PTE_D)) == pte)
+		return true;
+
+	level = walk (pml4, (uint64_t) upage, 1, path);
+	if (level < 0)
+		return false;
+	if (!(*path[level] & PTE_P)) {
+		table_cnt_add (path[level - 1], 1);
+		*path[level] = pte;
+	} else {
+		*path[level] = pte;
+		if (rcr3 () == vtop (pml4))
+			invlpg ((uint64_t) upage);
+	}
+	return true;
+}
+
+/* Maps the LARGE_PGSIZE bytes at user virtual address UPAGE in
+ * PML4 to the physically contiguous frames at kernel virtual
+ * address KPAGE with a single large page. Both addresses must be
+ * aligned to LARGE_PGSIZE. The large page is split back into
+ * pages as soon as one of them is changed on its own.
+ * Returns false if some page in the range is mapped already or
+ * memory allocation failed. */
+bool
+pml4_set_large_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t va = (uint64_t) upage;
+	uint64_t *path[PT_LEVELS];
+	uint64_t *pde;
+
+	ASSERT (va % LARGE_PGSIZE == 0);
+	ASSERT (vtop (kpage) % LARGE_PGSIZE == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	/* Make sure the page table for UPAGE exists, then replace it if it
+	 * maps nothing. A shared one always maps something. */
+	if (walk (pml4, va, 0, path) == PT_LEVELS - 1
+			&& PTE_CNT (*path[PT_LEVELS - 2]) > 0)
+		return false;
+	if (walk (pml4, va, 1, path) < 0)
+		return false;
+	pde = path[PT_LEVELS - 2];
+	if (PTE_CNT (*pde) > 0)
+		return false;
 
-	if (pte)
-		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
-	return pte != NULL;
+	palloc_free_page (ptov (PTE_ADDR (*pde)));
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	if (rcr3 () == vtop (pml4))
+		lcr3 (vtop (pml4));
+	return true;
+}
+
+/* Walks PML4 to the PTE of UPAGE like walk () without CREATE,
+ * but splits the large page that maps UPAGE, if any, and copies
+ * the shared page table holding a present PTE, so that the PTE
+ * may be changed. If that fails, the whole large page or shared
+ * table is made "not present" and -1 is returned. */
+static int
+walk_split (uint64_t *pml4, const void *upage, uint64_t *path[PT_LEVELS]) {
+	int level = walk (pml4, (uint64_t) upage, 0, path);
+
+	if (level == PT_LEVELS - 2 && (*path[level] & PTE_P)) {
+		if (walk (pml4, (uint64_t) upage, 1, path) == PT_LEVELS - 1)
+			return PT_LEVELS - 1;
+		clear_entry (pml4, path, level, (uint64_t) upage);
+		return -1;
+	}
+	if (level == PT_LEVELS - 1 && (*path[level] & PTE_P)
+			&& (*path[level - 1] & PTE_SHARED)) {
+		if (unshare_table (pml4, path[level - 1]))
+			return walk (pml4, (uint64_t) upage, 0, path);
+		/* The pages of the table fault back in one by one. */
+		drop_table (path);
+		if (rcr3 () == vtop (pml4))
+			lcr3 (vtop (pml4));
+		return -1;
+	}
+	return level;
 }
 
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
- * bits in the page table entry are preserved.
+ * bits in the page table entry are preserved, unless the page
+ * table becomes empty and is freed.
  * UPAGE need not be mapped. */
 void
 pml4_clear_page (uint64_t *pml4, void *upage) {
-	uint64_t *pte;
+	uint64_t *path[PT_LEVELS];
+	int level;
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
 
-	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	level = walk_split (pml4, upage, path);
 
-	if (pte != NULL && (*pte & PTE_P) != 0) {
-		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
-	}
+	if (level >= 0 && (*path[level] & PTE_P) != 0)
+		clear_entry (pml4, path, level, (uint64_t) upage);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
@@ -276,8 +660,10 @@ pml4_is_dirty (uint64_t *pml4, const void *vpage) {
  * in PML4. */
 void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
-	if (pte) {
+	uint64_t *path[PT_LEVELS];
+	int level = walk_split (pml4, vpage, path);
+	uint64_t *pte = level >= 0 ? path[level] : NULL;
+	if (pte && (*pte & PTE_P)) {
 		if (dirty)
 			*pte |= PTE_D;
 		else
@@ -288,10 +674,22 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 	}
 }
 
+/* Returns true if the PTE for virtual page VPAGE in PML4 lies in a page
+ * table shared with other address spaces, whose accessed bits are theirs
+ * as well. */
+bool
+pml4_is_shared (uint64_t *pml4, const void *vpage) {
+	uint64_t *path[PT_LEVELS];
+	int level = walk (pml4, (uint64_t) vpage, 0, path);
+
+	return level == PT_LEVELS - 1 && (*path[level - 1] & PTE_SHARED) != 0;
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PML4 has been
  * accessed recently, that is, between the time the PTE was
  * installed and the last time it was cleared.  Returns false if
- * PML4 contains no PTE for VPAGE. */
+ * PML4 contains no PTE for VPAGE.  All the pages of a large page
+ * share one accessed bit. */
 bool
 pml4_is_accessed (uint64_t *pml4, const void *vpage) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
@@ -299,7 +697,8 @@ pml4_is_accessed (uint64_t *pml4, const void *vpage) {
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  A shared page table is changed in place, like the
+   CPU does, for every address space sharing it. */
 void
 pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -31,6 +32,7 @@ struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t free_cnt;                /* Number of free pages. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -232,6 +234,11 @@ split:
 			}
 		}
 	}
+
+	kernel_pool.free_cnt = bitmap_count (kernel_pool.used_map, 0,
+			bitmap_size (kernel_pool.used_map), false);
+	user_pool.free_cnt = bitmap_count (user_pool.used_map, 0,
+			bitmap_size (user_pool.used_map), false);
 }
 
 /* Initializes the page allocator and get the memory size */
@@ -261,10 +268,46 @@ palloc_init (void) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
+	return palloc_get_aligned (flags, page_cnt, 1);
+}
+
+/* Returns the index of the first of PAGE_CNT free pages of POOL whose
+   address is a multiple of ALIGN pages and marks them used, or
+   BITMAP_ERROR.  Kernel virtual addresses are aligned just like the
+   physical addresses they map. */
+static size_t
+scan_aligned (struct pool *pool, size_t page_cnt, size_t align) {
+	size_t pool_cnt = bitmap_size (pool->used_map);
+	size_t page_idx;
+
+	if (align == 1)
+		return bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+
+	page_idx = (align - pg_no (pool->base) % align) % align;
+	for (; page_idx + page_cnt <= pool_cnt; page_idx += align)
+		if (bitmap_none (pool->used_map, page_idx, page_cnt)) {
+			bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+			return page_idx;
+		}
+	return BITMAP_ERROR;
+}
+
+/* Like palloc_get_multiple (), but the first page returned is
+   aligned to a multiple of ALIGN pages, both virtually and
+   physically. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
 
+	ASSERT (align > 0);
+
 	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	size_t page_idx = scan_aligned (pool, page_cnt, align);
+	if (page_idx != BITMAP_ERROR) {
+		enum intr_level old_level = intr_disable ();
+		pool->free_cnt -= page_cnt;
+		intr_set_level (old_level);
+	}
 	lock_release (&pool->lock);
 	void *pages;
 
@@ -301,6 +344,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
 	size_t page_idx;
+	enum intr_level old_level;
 
 	ASSERT (pg_ofs (pages) == 0);
 	if (pages == NULL || page_cnt == 0)
@@ -320,6 +364,18 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+
+	/* Pages are freed with interrupts off from the scheduler, so the count
+	 * cannot be protected by the pool lock. */
+	old_level = intr_disable ();
+	pool->free_cnt += page_cnt;
+	intr_set_level (old_level);
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void) {
+	return user_pool.free_cnt;
 }
 
 /* Frees the page at PAGE. */
@@ -475,6 +475,10 @@ init_thread(struct thread *t, const char *name, int priority)
     sema_init(&t->wait_sema, 0);
     /** -----------------------  */
 #endif
+#ifdef VM
+	list_init(&t->mmap_list);
+	list_init(&t->shm_list);
+#endif
 
 }
 
@@ -4,6 +4,8 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "userprog/syscall.h"
+#include "userprog/uaccess.h"
 #include "intrinsic.h"
 
 /* Number of page faults processed. */
@@ -149,6 +151,19 @@ page_fault (struct intr_frame *f) {
 	/* Count page faults. */
 	page_fault_cnt++;
 
+	/* The kernel touched a bad user address on purpose: let the accessor
+	   report the error. */
+	if (!user) {
+		const struct exception_entry *e = search_exception_table (f->rip);
+		if (e != NULL) {
+			f->rip = e->fixup;
+			return;
+		}
+	}
+
+	/* A bad user pointer faulted inside a file system call. */
+	if (lock_held_by_current_thread (&filesys_lock))
+		lock_release (&filesys_lock);
     exit_syscall(-1); /** Test Case 가 Hardware 수준에서 페이지 폴트를 호출하기 때문에 Test Case 통과를 위해서 exception을 수정해야함. */
 
     /* If the fault is true fault, show info and exit. */
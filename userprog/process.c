@@ -14,6 +14,7 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
@@ -27,6 +28,9 @@ static void process_cleanup (void);
 static bool load (const char *file_name, struct intr_frame *if_);
 static void initd (void *f_name);
 static void __do_fork (void *);
+static void __do_spawn (void *);
+static void __do_vfork (void *);
+static bool process_load (char *file_name, struct intr_frame *if_);
 
 /* General process initializer for initd and other process. */
 static void
@@ -141,6 +145,31 @@ duplicate_pte (uint64_t *pte, void *va, void *aux) {
 }
 #endif
 
+/* Gives the current process its own copy of every file descriptor of
+ * PARENT. */
+static bool
+duplicate_fd_table (struct thread *parent) {
+	struct thread *current = thread_current ();
+
+	if(parent->fd_idx >= FDCOUNT_LIMIT)
+		return false;
+
+	current->fd_idx = parent->fd_idx;
+	struct file *file;
+	for (int fd = 0; fd < FDCOUNT_LIMIT ; fd ++){
+		file = parent->fd_table[fd];
+		if (file == NULL)
+			continue;
+
+		if (file >STDERR){
+			current->fd_table[fd] = file_duplicate(file);
+		}else{
+			current->fd_table[fd] = file;
+		}
+	}
+	return true;
+}
+
 /* A thread function that copies parent's execution context.
  * Hint) parent->tf does not hold the userland context of the process.
  *       That is, you are required to pass second argument of process_fork to
@@ -167,32 +196,30 @@ __do_fork (void *aux) {
 		goto error;
 
 	process_activate (current);
+
+	/* Keep our own handle on the executable: lazily loaded pages read from
+	 * it and it stays write-protected until we exit. */
+	if (parent->running_file != NULL) {
+		current->running_file = file_duplicate (parent->running_file);
+		if (current->running_file == NULL)
+			goto error;
+	}
 #ifdef VM
 	supplemental_page_table_init (&current->spt);
+	current->rss_limit = parent->rss_limit;
 	if (!supplemental_page_table_copy (&current->spt, &parent->spt))
 		goto error;
+	vm_fork_page_tables (parent);
+	if (!shm_fork (parent))
+		goto error;
 #else
 	if (!pml4_for_each (parent->pml4, duplicate_pte, parent))
 		goto error;
 #endif
 
-	if(parent->fd_idx >= FDCOUNT_LIMIT)
+	if (!duplicate_fd_table (parent))
 		goto error;
 
-	current->fd_idx = parent->fd_idx;
-	struct file *file;
-	for (int fd = 0; fd < FDCOUNT_LIMIT ; fd ++){
-		file = parent->fd_table[fd];
-		if (file == NULL)
-			continue;
-
-		if (file >STDERR){
-			current->fd_table[fd] = file_duplicate(file);
-		}else{
-			current->fd_table[fd] = file;
-		}
-	}
-
 	sema_up(&current->fork_sema);
 
 	process_init ();
@@ -209,19 +236,35 @@ error:
  * Returns -1 on fail. */
 int
 process_exec (void *f_name) {
-	char *file_name = f_name;
+	struct intr_frame _if;
+
+	if (!process_load (f_name, &_if))
+		return -1;
+
+	/* Start switched process. */
+	do_iret (&_if);
+	NOT_REACHED ();
+}
+
+/* Replaces the current process's image with the program and arguments in
+ * FILE_NAME, a page that is freed, and sets up _IF to start it. Returns
+ * false if the program could not be loaded. */
+static bool
+process_load (char *file_name, struct intr_frame *if_) {
 	bool success;
 
 	/* We cannot use the intr_frame in the thread structure.
 	 * This is because when current thread rescheduled,
 	 * it stores the execution information to the member. */
-	struct intr_frame _if;
-	_if.ds = _if.es = _if.ss = SEL_UDSEG;
-	_if.cs = SEL_UCSEG;
-	_if.eflags = FLAG_IF | FLAG_MBS;
+	if_->ds = if_->es = if_->ss = SEL_UDSEG;
+	if_->cs = SEL_UCSEG;
+	if_->eflags = FLAG_IF | FLAG_MBS;
 
 	/* We first kill the current context */
 	process_cleanup ();
+#ifdef VM
+	memset (&thread_current ()->vmstat, 0, sizeof (struct vmstat));
+#endif
 
 		// ==== argument parsing ====
 	// argv_list , argc_num 만들기
@@ -241,19 +284,186 @@ process_exec (void *f_name) {
 	// ==== argument parsing ====
 
 	/* And then load the binary */
-	success = load (file_name, &_if);
-	if (!success){
-		palloc_free_page (file_name);
-		return -1;
-	}
-	setup_argument(argv_list,agrc_num,&_if);
+	success = load (file_name, if_);
 	/* If load failed, quit. */
+	if (success)
+		setup_argument(argv_list,agrc_num,if_);
 	palloc_free_page (file_name);
-	/* Start switched process. */
-	do_iret (&_if);
-	NOT_REACHED ();
+	return success;
+}
+
+/* What a spawned child needs from its parent, which waits on the child's
+ * fork_sema while the child uses it. */
+struct spawn_args {
+	struct thread *parent;
+	char *cmd_line;
+	const struct spawn_action *actions;
+	size_t action_cnt;
+	bool success;
+};
+
+/* Starts a child process running CMD_LINE, a page that this function
+ * frees, without copying the address space of the current process. The
+ * child inherits the file descriptors, then applies the ACTION_CNT
+ * ACTIONS to them. Returns the child's thread id once the program is
+ * loaded, or TID_ERROR if anything failed. */
+tid_t
+process_spawn (char *cmd_line, const struct spawn_action *actions,
+		size_t action_cnt) {
+	struct spawn_args args = {
+		.parent = thread_current (),
+		.cmd_line = cmd_line,
+		.actions = actions,
+		.action_cnt = action_cnt,
+	};
+	char name[16];
+	char *save_ptr;
+
+	strlcpy (name, cmd_line, sizeof name);
+	strtok_r (name, " ", &save_ptr);
+
+	tid_t tid = thread_create (name, PRI_DEFAULT, __do_spawn, &args);
+	if (tid == TID_ERROR) {
+		palloc_free_page (cmd_line);
+		return TID_ERROR;
+	}
+
+	THREAD *child = get_thread(tid);
+	sema_down(&child->fork_sema);
+
+	if (!args.success) {
+		/* Reap the child, which exits right away. */
+		process_wait (tid);
+		return TID_ERROR;
+	}
+	return tid;
+}
+
+/* Applies the file descriptor ACTION to the current process. */
+static bool
+apply_spawn_action (const struct spawn_action *action) {
+	struct thread *curr = thread_current ();
+	struct file *file = get_file_from_fd (action->fd);
+
+	if (file == NULL)
+		return false;
+	if (action->target == SPAWN_CLOSE) {
+		close_syscall (action->fd);
+		return true;
+	}
+	if (action->target < 0 || action->target >= FDCOUNT_LIMIT)
+		return false;
+	if (action->target == action->fd)
+		return true;
+
+	close_syscall (action->target);
+	/* STDIN to STDERR stand for the console, not an open file. */
+	if ((uintptr_t) file > STDERR)
+		file->dup_count++;
+	curr->fd_table[action->target] = file;
+	if (action->target >= curr->fd_idx)
+		curr->fd_idx = action->target + 1;
+	return true;
+}
+
+/* A thread function that starts a spawned process. */
+static void
+__do_spawn (void *aux) {
+	struct spawn_args *args = aux;
+	struct thread *current = thread_current ();
+	struct intr_frame if_;
+	bool success;
+
+#ifdef VM
+	supplemental_page_table_init (&current->spt);
+	current->rss_limit = args->parent->rss_limit;
+#endif
+	process_init ();
+
+	success = duplicate_fd_table (args->parent);
+	for (size_t i = 0; success && i < args->action_cnt; i++)
+		success = apply_spawn_action (&args->actions[i]);
+
+	if (success)
+		success = process_load (args->cmd_line, &if_);
+	else
+		palloc_free_page (args->cmd_line);
+
+	/* ARGS is gone once the parent wakes up. */
+	args->success = success;
+	sema_up(&current->fork_sema);
+
+	if (success)
+		do_iret (&if_);
+	exit_syscall(-1);
+}
+
+/* What a vfork () child needs from its parent, which waits on the child's
+ * fork_sema while the child uses it. */
+struct vfork_args {
+	struct thread *parent;
+	bool success;
+};
+
+/* Clones the current process like process_fork (), but the child borrows
+ * the address space of the current process instead of copying it. The
+ * current process sleeps until the child gives the address space back by
+ * exec or exit, so the child must do nothing else. Returns the child's
+ * thread id, or TID_ERROR if the child cannot be created. */
+tid_t
+process_vfork (void) {
+	THREAD *curr = thread_current();
+	struct vfork_args args = { .parent = curr };
+	struct intr_frame *tf = (pg_round_up(rrsp()) - sizeof(struct intr_frame));
+	memcpy(&curr->parent_if, tf,sizeof(struct intr_frame));
+
+	tid_t tid = thread_create(curr->name,PRI_DEFAULT,__do_vfork,&args);
+
+	if (tid == TID_ERROR)
+		return TID_ERROR;
+
+	THREAD *child = get_thread(tid);
+
+	sema_down(&child->fork_sema); // child가 exec 또는 exit으로 주소 공간을 돌려줄 때까지 대기
+
+	if (!args.success) {
+		process_wait (tid);
+		return TID_ERROR;
+	}
+	return tid;
 }
 
+/* A thread function that starts a vfork () child on the address space of
+ * its parent. */
+static void
+__do_vfork (void *aux) {
+	struct vfork_args *args = aux;
+	struct thread *parent = args->parent;
+	struct thread *current = thread_current ();
+	struct intr_frame if_;
+
+	memcpy (&if_, &parent->parent_if, sizeof (struct intr_frame));
+	if_.R.rax = 0;
+
+#ifdef VM
+	supplemental_page_table_init (&current->spt);
+	current->rss_limit = parent->rss_limit;
+#endif
+	process_init ();
+
+	if (!duplicate_fd_table (parent)) {
+		sema_up(&current->fork_sema);
+		exit_syscall(-1);
+	}
+
+	/* From here on the parent wakes up only when we let go of its address
+	 * space in process_cleanup (). */
+	args->success = true;
+	current->vfork_parent = parent;
+	current->pml4 = parent->pml4;
+	process_activate (current);
+	do_iret (&if_);
+}
 
 /* Waits for thread TID to die and returns its exit status.  If
  * it was terminated by the kernel (i.e. killed due to an
@@ -298,6 +508,19 @@ process_exit (void) {
 
 	file_close(curr->running_file);
 
+#ifdef VM
+	if (vm_stats_enabled && curr->pml4 != NULL && curr->vfork_parent == NULL) {
+		curr->vmstat.pt_pages = pml4_table_cnt (curr->pml4);
+		curr->vmstat.working_set = vm_working_set ();
+		printf ("vmstat %s: minflt=%zu majflt=%zu cowflt=%zu stkflt=%zu "
+				"evicted=%zu swapin=%zu rss=%zu ws=%zu swap=%zu ptpages=%zu\n",
+				curr->name, curr->vmstat.minor_faults,
+				curr->vmstat.major_faults, curr->vmstat.cow_faults,
+				curr->vmstat.stack_faults, curr->vmstat.evicted,
+				curr->vmstat.swapped_in, curr->vmstat.rss,
+				curr->vmstat.working_set, curr->vmstat.swap_slots, curr->vmstat.pt_pages);
+	}
+#endif
 	process_cleanup ();
 
 	sema_up(&curr->wait_sema); // 자식 프로세스가 종료될 때 부모에게 signal
@@ -311,6 +534,15 @@ static void
 process_cleanup (void) {
 	struct thread *curr = thread_current ();
 
+	if (curr->vfork_parent != NULL) {
+		/* The page directory is borrowed: give it back and wake up the
+		 * parent. */
+		curr->pml4 = NULL;
+		pml4_activate (NULL);
+		curr->vfork_parent = NULL;
+		sema_up (&curr->fork_sema);
+	}
+
 #ifdef VM
 	supplemental_page_table_kill (&curr->spt);
 #endif
@@ -668,9 +900,19 @@ install_page (void *upage, void *kpage, bool writable) {
 
 static bool
 lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
+	struct lazy_load_arg *arg = aux;
+	bool success = true;
+
+	/* The frame is already zeroed, so only the file part is left. It may
+	 * have been read already, around a fault on a neighboring page. */
+	page->area = arg->area;
+	if (arg->preload != NULL)
+		memcpy (page->frame->kva, arg->preload, arg->read_bytes);
+	else
+		success = file_read_at (arg->file, page->frame->kva, arg->read_bytes,
+				arg->ofs) == (off_t) arg->read_bytes;
+	free (arg);
+	return success;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -694,25 +936,56 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0) {
+	/* The pages read from the file make up one area for fault-around. */
+	struct vm_area *area = vm_area_create ();
+	bool success = area != NULL;
+
+	while (success && (read_bytes > 0 || zero_bytes > 0)) {
 		/* Do calculate how to fill this page.
 		 * We will read PAGE_READ_BYTES bytes from FILE
 		 * and zero the final PAGE_ZERO_BYTES bytes. */
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
-			return false;
+		if (page_read_bytes == 0) {
+			/* Nothing to read (bss): a plain anonymous page starts out on
+			 * the shared zero page. */
+			success = vm_alloc_page (VM_ANON, upage, writable);
+		} else {
+			struct lazy_load_arg *aux = malloc (sizeof *aux);
+			if (aux == NULL) {
+				success = false;
+				break;
+			}
+			*aux = (struct lazy_load_arg) {
+				.file = file,
+				.ofs = ofs,
+				.read_bytes = page_read_bytes,
+				.zero_bytes = page_zero_bytes,
+				.area = vm_area_get (area),
+			};
+			/* Read-only pages stay backed by the executable, so that
+			 * processes running it share their frames. */
+			if (writable)
+				success = vm_alloc_page_with_initializer (VM_ANON, upage,
+						writable, lazy_load_segment, aux);
+			else
+				success = vm_alloc_page_with_initializer (VM_FILE, upage,
+						writable, NULL, aux);
+			if (!success) {
+				vm_area_put (area);
+				free (aux);
+			}
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
+		ofs += page_read_bytes;
 		upage += PGSIZE;
 	}
-	return true;
+	vm_area_put (area);
+	return success;
 }
 
 /* Create a PAGE of stack at the USER_STACK. Return true on success. */
@@ -721,10 +994,12 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
+	/* The arguments are pushed right away, so claim the page now. */
+	if (vm_alloc_page (VM_ANON | VM_STACK, stack_bottom, true)
+			&& vm_claim_page (stack_bottom)) {
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 
 	return success;
 }
@@ -1,6 +1,7 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
 #include <syscall-nr.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/loader.h"
@@ -11,12 +12,18 @@
 /** #Project 2: System Call */
 typedef int pid_t;
 #include <string.h>
+#include <round.h>
 
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "userprog/process.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 struct lock filesys_lock;
 /** -----------------------  */
@@ -57,6 +64,9 @@ void
 syscall_handler (struct intr_frame *f UNUSED) {
 	// TODO: Your implementation goes here.
 	// printf ("system call!\n");
+#ifdef VM
+	thread_current()->user_rsp = (void *) f->rsp;
+#endif
 
 switch (f->R.rax)
 	{
@@ -69,6 +79,12 @@ switch (f->R.rax)
 	case SYS_FORK:
 		f->R.rax =fork_syscall(f->R.rdi);
 		break;
+	case SYS_SPAWN:
+		f->R.rax = spawn_syscall((const char *) f->R.rdi, (const struct spawn_action *) f->R.rsi);
+		break;
+	case SYS_VFORK:
+		f->R.rax = vfork_syscall();
+		break;
 	case SYS_EXEC:
 		if (exec_syscall(f->R.rdi) == -1)
         {
@@ -78,6 +94,9 @@ switch (f->R.rax)
 	case SYS_WAIT:
 		f->R.rax =wait_syscall(f->R.rdi);
 		break;
+	case SYS_TICKS:
+		f->R.rax = timer_ticks();
+		break;
 	case SYS_CREATE:
 		f->R.rax = create_syscall(f->R.rdi,f->R.rsi);
 		break;
@@ -105,6 +124,35 @@ switch (f->R.rax)
 	case SYS_CLOSE:
 		close_syscall(f->R.rdi);
 		break;
+#ifdef VM
+	case SYS_MMAP:
+		f->R.rax = (uint64_t) mmap_syscall((void *) f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10, f->R.r8);
+		break;
+	case SYS_MUNMAP:
+		munmap_syscall((void *) f->R.rdi);
+		break;
+	case SYS_MADVISE:
+		f->R.rax = madvise_syscall((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+		break;
+	case SYS_MSYNC:
+		f->R.rax = msync_syscall((void *) f->R.rdi, f->R.rsi);
+		break;
+	case SYS_VMSTAT:
+		f->R.rax = vmstat_syscall((struct vmstat *) f->R.rdi);
+		break;
+	case SYS_RSS_LIMIT:
+		f->R.rax = rss_limit_syscall(f->R.rdi);
+		break;
+	case SYS_SHM_CREATE:
+		f->R.rax = shm_create_syscall(f->R.rdi, f->R.rsi);
+		break;
+	case SYS_SHM_ATTACH:
+		f->R.rax = (uint64_t) shm_attach_syscall(f->R.rdi, (void *) f->R.rsi);
+		break;
+	case SYS_SHM_DETACH:
+		f->R.rax = shm_detach_syscall((void *) f->R.rdi);
+		break;
+#endif
 	default:
 		exit_syscall(-1);
 		break;
@@ -113,10 +161,22 @@ switch (f->R.rax)
 
 // ================================= utils =================================
 void check_address(void *addr) {
-    struct thread *curr = thread_current();
+    /* Only the range is checked. Unmapped addresses fault when used, and
+     * the page fault handler sorts them out. */
+    if (is_kernel_vaddr(addr) || addr == NULL)
+        exit_syscall(-1);
+}
+
+/* Copies the file name at user address UNAME into NAME. A name too long
+ * for any file is cut to NAME_MAX + 1 characters, which the file system
+ * then rejects. Exits the process if UNAME is invalid. */
+static void copy_name(char name[NAME_MAX + 2], const char *uname) {
+    int len = strncpy_from_user(name, uname, NAME_MAX + 2);
 
-    if (is_kernel_vaddr(addr) || addr == NULL || pml4_get_page(curr->pml4, addr) == NULL)
+    if (len < 0)
         exit_syscall(-1);
+    if (len == NAME_MAX + 2)
+        name[NAME_MAX + 1] = '\0';
 }
 
 
@@ -143,49 +203,95 @@ pid_t fork_syscall(const char *thread_name){
 }
 
 int exec_syscall(const char *cmd_line){
-	check_address(cmd_line);
-
-	off_t size = strlen(cmd_line)+1;
 	char *cmd_copy = palloc_get_page(PAL_ZERO);
 
 	if(cmd_copy == NULL){
 		return -1;
 	}
 
-	memcpy(cmd_copy,cmd_line,size);
+	/* A bad or too long command line fails the exec. */
+	int len = strncpy_from_user(cmd_copy, cmd_line, PGSIZE);
+	if(len < 0 || len == PGSIZE){
+		palloc_free_page(cmd_copy);
+		return -1;
+	}
 
 	return process_exec(cmd_copy);
 }
 
+pid_t spawn_syscall(const char *cmd_line, const struct spawn_action *actions){
+	struct spawn_action acts[SPAWN_ACTION_MAX];
+	size_t cnt = 0;
+
+	/* Copy the actions up to the terminating one. */
+	for(; actions != NULL; cnt++){
+		struct spawn_action act;
+
+		if(!copy_from_user(&act, &actions[cnt], sizeof act))
+			exit_syscall(-1);
+		if(act.fd < 0)
+			break;
+		if(cnt == SPAWN_ACTION_MAX)
+			return PID_ERROR;
+		acts[cnt] = act;
+	}
+
+	char *cmd_copy = palloc_get_page(PAL_ZERO);
+	if(cmd_copy == NULL)
+		return PID_ERROR;
+
+	int len = strncpy_from_user(cmd_copy, cmd_line, PGSIZE);
+	if(len < 0){
+		palloc_free_page(cmd_copy);
+		exit_syscall(-1);
+	}
+	if(len == 0 || len == PGSIZE){
+		palloc_free_page(cmd_copy);
+		return PID_ERROR;
+	}
+
+	return process_spawn(cmd_copy, acts, cnt);
+}
+
+pid_t vfork_syscall(void){
+	return process_vfork();
+}
+
 int wait_syscall(pid_t tid){
 	return process_wait(tid);
 }
 
 bool create_syscall(const char *file, unsigned initial_size){
-	check_address(file);
+	char name[NAME_MAX + 2];
+
+	copy_name(name, file);
 
 	lock_acquire(&filesys_lock);
-	bool success = filesys_create(file,initial_size);
+	bool success = filesys_create(name,initial_size);
 	lock_release(&filesys_lock);
 
 	return success;
 }
 
 bool remove_syscall(const char *file){
-	check_address(file);
+	char name[NAME_MAX + 2];
+
+	copy_name(name, file);
 
 	lock_acquire(&filesys_lock);
-	bool success = filesys_remove(file);
+	bool success = filesys_remove(name);
 	lock_release(&filesys_lock);
 
 	return success;
 }
 
 int open_syscall(const char *file){
-	check_address(file);
+	char name[NAME_MAX + 2];
+
+	copy_name(name, file);
 
 	lock_acquire(&filesys_lock);
-	struct file *new_file = filesys_open(file);
+	struct file *new_file = filesys_open(name);
 
 	if(new_file==NULL){
 		goto err;
@@ -217,7 +323,6 @@ int filesize_syscall(int fd){
 int read_syscall(int fd, void *buffer, unsigned length){
 	check_address(buffer);
 
-	struct thread *curr = thread_current();
 	struct file *file = get_file_from_fd(fd);
 
 	if(file == NULL || file == STDOUT || file == STDERR)
@@ -230,42 +335,81 @@ int read_syscall(int fd, void *buffer, unsigned length){
 
 		for (; i<length;i++){
 			c = input_getc();
-			*buf++ = c;
+			if(!copy_to_user(buf++, &c, 1))
+				exit_syscall(-1);
 			if(c=='\0')
 				break;
 		}
 		return i;
 	}
 
-    lock_acquire(&filesys_lock);
-    off_t bytes = file_read(file, buffer, length);
-    lock_release(&filesys_lock);
+	/* The file is read into a kernel page, so that the user buffer is
+	 * never touched with filesys_lock held. */
+	char *kbuf = palloc_get_page(0);
+	unsigned bytes = 0;
 
-    return bytes;
+	if(kbuf == NULL)
+		return -1;
+
+	while(bytes < length){
+		unsigned chunk = length - bytes < PGSIZE ? length - bytes : PGSIZE;
+
+		lock_acquire(&filesys_lock);
+		off_t n = file_read(file, kbuf, chunk);
+		lock_release(&filesys_lock);
+
+		if(n > 0 && !copy_to_user((uint8_t *) buffer + bytes, kbuf, n)){
+			palloc_free_page(kbuf);
+			exit_syscall(-1);
+		}
+		bytes += n;
+		if(n < (off_t) chunk)
+			break;
+	}
+
+	palloc_free_page(kbuf);
+	return bytes;
 }
 
 int write_syscall(int fd, const void *buffer, unsigned length){
 	check_address(buffer);
 
-	lock_acquire(&filesys_lock);
-	struct thread *curr = thread_current();
-	off_t bytes = -1;
-
 	struct file *file = get_file_from_fd(fd);
 
 	if(file == STDIN || file == NULL)
-		goto done;
+		return -1;
 
-	if(file == STDOUT || file == STDERR){
-		putbuf(buffer, length);
-		bytes = length;
-		goto done;
+	char *kbuf = palloc_get_page(0);
+	unsigned bytes = 0;
+
+	if(kbuf == NULL)
+		return -1;
+
+	while(bytes < length){
+		unsigned chunk = length - bytes < PGSIZE ? length - bytes : PGSIZE;
+		off_t n;
+
+		if(!copy_from_user(kbuf, (const uint8_t *) buffer + bytes, chunk)){
+			palloc_free_page(kbuf);
+			exit_syscall(-1);
+		}
+
+		if(file == STDOUT || file == STDERR){
+			putbuf(kbuf, chunk);
+			n = chunk;
+		}
+		else{
+			lock_acquire(&filesys_lock);
+			n = file_write(file, kbuf, chunk);
+			lock_release(&filesys_lock);
+		}
+
+		bytes += n;
+		if(n < (off_t) chunk)
+			break;
 	}
-	
-	bytes = file_write(file,buffer,length);
 
-done:
-	lock_release(&filesys_lock);
+	palloc_free_page(kbuf);
 	return bytes;
 }
 
@@ -308,4 +452,84 @@ void close_syscall(int fd){
 	}
 done:
 	return;
-}
\ No newline at end of file
+}
+
+#ifdef VM
+void *mmap_syscall(void *addr, size_t length, int writable, int fd, off_t offset){
+	struct thread *curr = thread_current();
+	struct file *file = get_file_from_fd(fd);
+	bool populate = (writable & MAP_POPULATE) != 0;
+
+	// MAP_POPULATE는 writable 검사 전에 떼어 낸다
+	writable &= ~MAP_POPULATE;
+
+	if(file == NULL || (file >= STDIN && file <= STDERR))
+		return NULL;
+
+	if(addr == NULL || pg_ofs(addr) != 0 || offset % PGSIZE != 0 || (long long) length <= 0)
+		return NULL;
+
+	if(is_kernel_vaddr(addr) || is_kernel_vaddr((uint8_t *) addr + length - 1)
+			|| (uint8_t *) addr + length < (uint8_t *) addr)
+		return NULL;
+
+	if(file_length(file) == 0)
+		return NULL;
+
+	// 기존 페이지와 겹치면 실패
+	for(uint8_t *upage = addr; upage < (uint8_t *) addr + length; upage += PGSIZE){
+		if(spt_find_page(&curr->spt, upage) != NULL)
+			return NULL;
+	}
+
+	addr = do_mmap(addr, length, writable, file, offset);
+	// MAP_POPULATE: 매핑 전체를 한 번에 읽어 둔다
+	if(addr != NULL && populate)
+		vm_populate(addr, DIV_ROUND_UP(length, PGSIZE));
+	return addr;
+}
+
+void munmap_syscall(void *addr){
+	do_munmap(addr);
+}
+
+int madvise_syscall(void *addr, size_t length, int advice){
+	if(addr == NULL || is_kernel_vaddr(addr) || (long long) length <= 0)
+		return -1;
+	return do_madvise(addr, length, advice) ? 0 : -1;
+}
+
+int msync_syscall(void *addr, size_t length){
+	if(addr == NULL || is_kernel_vaddr(addr) || (long long) length <= 0)
+		return -1;
+	return do_msync(addr, length) ? 0 : -1;
+}
+
+int vmstat_syscall(struct vmstat *st){
+	thread_current()->vmstat.pt_pages = pml4_table_cnt(thread_current()->pml4);
+	thread_current()->vmstat.working_set = vm_working_set();
+	if(!copy_to_user(st, &thread_current()->vmstat, sizeof *st))
+		exit_syscall(-1);
+	return 0;
+}
+
+size_t rss_limit_syscall(size_t page_cnt){
+	return vm_set_rss_limit(page_cnt);
+}
+
+bool shm_create_syscall(int key, size_t size){
+	if((long long) size <= 0)
+		return false;
+	return shm_create(key, size);
+}
+
+void *shm_attach_syscall(int key, void *addr){
+	if(addr == NULL || is_kernel_vaddr(addr))
+		return NULL;
+	return shm_attach(key, addr);
+}
+
+bool shm_detach_syscall(void *addr){
+	return shm_detach(addr);
+}
+#endif
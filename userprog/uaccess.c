@@ -0,0 +1,107 @@
+/* uaccess.c: Copying between the kernel and user memory.
+ *
+ * Each instruction that touches user memory gets an entry in the
+ * __ex_table section naming the instruction to resume at if it faults.
+ * page_fault () looks the faulting rip up there once the VM had no way to
+ * bring the page in, so a bad pointer costs nothing until it is used. */
+
+#include "userprog/uaccess.h"
+#include "threads/vaddr.h"
+
+/* Emits an exception table entry: a fault at INSN resumes at FIXUP. */
+#define EX_ENTRY(INSN, FIXUP)            \
+	".pushsection __ex_table, \"a\"\n"   \
+	".balign 8\n"                        \
+	".quad " #INSN ", " #FIXUP "\n"      \
+	".popsection\n"
+
+/* Bounds of the exception table, provided by the linker script. */
+extern const struct exception_entry __start_ex_table[];
+extern const struct exception_entry __stop_ex_table[];
+
+/* Returns true if SIZE bytes at UADDR are all user addresses. */
+static bool
+is_user_range (const void *uaddr, size_t size) {
+	uintptr_t start = (uintptr_t) uaddr;
+
+	return size == 0
+		|| (start + size - 1 >= start && is_user_vaddr (start + size - 1));
+}
+
+/* Copies SIZE bytes from SRC to DST with rep movsb, one side of which is
+ * user memory. Returns the number of bytes not copied because of a
+ * fault. */
+static size_t
+copy_user (void *dst, const void *src, size_t size) {
+	asm volatile ("1: rep movsb\n"
+			"2:\n"
+			EX_ENTRY (1b, 2b)
+			: "+D" (dst), "+S" (src), "+c" (size)
+			:
+			: "memory");
+	return size;
+}
+
+/* Copies SIZE bytes from user address USRC to DST. Returns false if the
+ * user range is invalid. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size) {
+	return is_user_range (usrc, size) && copy_user (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from SRC to user address UDST. Returns false if the
+ * user range is invalid or read-only. */
+bool
+copy_to_user (void *udst, const void *src, size_t size) {
+	return is_user_range (udst, size) && copy_user (udst, src, size) == 0;
+}
+
+/* Reads the byte at user address USRC into *DST. Returns false if it
+ * faulted. */
+static bool
+get_user (uint8_t *dst, const uint8_t *usrc) {
+	int fault;
+	uint8_t byte;
+
+	asm volatile ("movl $1, %0\n"
+			"1: movb %2, %1\n"
+			"xorl %0, %0\n"
+			"2:\n"
+			EX_ENTRY (1b, 2b)
+			: "=&r" (fault), "=&q" (byte)
+			: "m" (*usrc));
+	if (fault)
+		return false;
+	*dst = byte;
+	return true;
+}
+
+/* Copies the null-terminated string at user address USRC into DST, which
+ * holds SIZE bytes. Returns the length of the string, SIZE if it did not
+ * fit (DST is then not terminated), or -1 if USRC is invalid. */
+int
+strncpy_from_user (char *dst, const char *usrc, size_t size) {
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		const uint8_t *uaddr = (const uint8_t *) usrc + i;
+
+		if (!is_user_vaddr (uaddr) || !get_user ((uint8_t *) &dst[i], uaddr))
+			return -1;
+		if (dst[i] == '\0')
+			return i;
+	}
+	return size;
+}
+
+/* Returns the exception table entry for the instruction at RIP, or NULL
+ * if a fault there is a kernel bug. */
+const struct exception_entry *
+search_exception_table (uintptr_t rip) {
+	const struct exception_entry *e;
+
+	for (e = __start_ex_table; e < __stop_ex_table; e++)
+		if (e->insn == rip)
+			return e;
+	return NULL;
+}
@@ -1,7 +1,14 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <bitmap.h>
+#include <string.h>
 #include "vm/vm.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in a swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -9,6 +16,12 @@ static bool anon_swap_in (struct page *page, void *kva);
 static bool anon_swap_out (struct page *page);
 static void anon_destroy (struct page *page);
 
+/* Slots in use, and how many pages refer to each of them. A slot is shared
+ * when a swapped page is inherited by fork or a shared frame is evicted. */
+static struct bitmap *swap_table;
+static uint16_t *swap_refs;
+static struct lock swap_lock;
+
 /* DO NOT MODIFY this struct */
 static const struct page_operations anon_ops = {
 	.swap_in = anon_swap_in,
@@ -20,33 +33,140 @@ static const struct page_operations anon_ops = {
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	size_t slot_cnt;
+
+	swap_disk = disk_get (1, 1);
+	slot_cnt = swap_disk != NULL ? disk_size (swap_disk) / SECTORS_PER_SLOT : 0;
+
+	swap_table = bitmap_create (slot_cnt);
+	swap_refs = calloc (slot_cnt, sizeof *swap_refs);
+	if (swap_table == NULL || (slot_cnt > 0 && swap_refs == NULL))
+		PANIC ("cannot allocate swap table");
+	lock_init (&swap_lock);
+}
+
+/* Drops a reference to SLOT, freeing it with the last one. */
+void
+swap_slot_put (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (swap_refs[slot] > 0);
+	if (--swap_refs[slot] == 0)
+		bitmap_reset (swap_table, slot);
+	lock_release (&swap_lock);
+}
+
+/* Writes the page at KVA to a free swap slot holding one reference and
+ * returns the slot, or SWAP_SLOT_NONE if the swap disk is full. */
+size_t
+swap_write (const void *kva) {
+	size_t slot;
+
+	lock_acquire (&swap_lock);
+	slot = bitmap_scan_and_flip (swap_table, 0, 1, false);
+	if (slot != BITMAP_ERROR)
+		swap_refs[slot] = 1;
+	lock_release (&swap_lock);
+	if (slot == BITMAP_ERROR)
+		return SWAP_SLOT_NONE;
+
+	for (int i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_write (swap_disk, slot * SECTORS_PER_SLOT + i,
+				(const uint8_t *) kva + i * DISK_SECTOR_SIZE);
+	return slot;
+}
+
+/* Writes FRAME to a free swap slot like swap_write (), unless the
+ * reclaim daemon wrote it already: then hands over that slot. */
+size_t
+swap_write_frame (struct frame *frame) {
+	size_t slot = frame->swap_slot;
+
+	if (slot == SWAP_SLOT_NONE)
+		return swap_write (frame->kva);
+	frame->swap_slot = SWAP_SLOT_NONE;
+	return slot;
+}
+
+/* Reads swap SLOT into the page at KVA. */
+void
+swap_read (size_t slot, void *kva) {
+	for (int i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_read (swap_disk, slot * SECTORS_PER_SLOT + i,
+				(uint8_t *) kva + i * DISK_SECTOR_SIZE);
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED, void *kva) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->swap_slot = SWAP_SLOT_NONE;
+
+	/* A page mapped to the shared zero frame has no KVA of its own. */
+	if (kva != NULL)
+		memset (kva, 0, PGSIZE);
+	return true;
+}
+
+/* Makes non-resident page DST refer to the swap slot of SRC. */
+void
+anon_share_swap (struct page *dst, struct page *src) {
+	size_t slot = src->anon.swap_slot;
+
+	dst->anon.swap_slot = slot;
+	if (slot == SWAP_SLOT_NONE)
+		return;
+
+	lock_acquire (&swap_lock);
+	ASSERT (swap_refs[slot] > 0);
+	swap_refs[slot]++;
+	lock_release (&swap_lock);
+	dst->owner->vmstat.swap_slots++;
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	size_t slot = anon_page->swap_slot;
+
+	if (slot == SWAP_SLOT_NONE)
+		return false;
+
+	swap_read (slot, kva);
+	anon_page->swap_slot = SWAP_SLOT_NONE;
+	swap_slot_put (slot);
+	page->owner->vmstat.swap_slots--;
+	page->owner->vmstat.swapped_in++;
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	size_t slot = swap_write_frame (page->frame);
+
+	if (slot == SWAP_SLOT_NONE)
+		return false;
+
+	anon_page->swap_slot = slot;
+	page->owner->vmstat.swap_slots++;
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->swap_slot != SWAP_SLOT_NONE) {
+		swap_slot_put (anon_page->swap_slot);
+		anon_page->swap_slot = SWAP_SLOT_NONE;
+		page->owner->vmstat.swap_slots--;
+	}
+	vm_unmap_page (page);
+	vm_area_put (page->area);
 }
@@ -1,6 +1,15 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <round.h>
+#include <string.h>
 #include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+
+/* Most pages written back with a single write. */
+#define WRITEBACK_BATCH 16
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
@@ -21,38 +30,321 @@ vm_file_init (void) {
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva) {
+	/* The aux shares the union with file_page, so fetch it first. */
+	struct lazy_load_arg *arg = page->uninit.aux;
+	const void *preload;
+
 	/* Set up the handler */
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	file_page->file = arg->file;
+	file_page->ofs = arg->ofs;
+	file_page->read_bytes = arg->read_bytes;
+	file_page->zero_bytes = arg->zero_bytes;
+	page->area = arg->area;
+	preload = arg->preload;
+	free (arg);
+
+	/* A page joining a frame of shared text has nothing to read. */
+	if (kva == NULL)
+		return true;
+
+	if (preload != NULL) {
+		/* Read ahead of the fault together with its neighbors. */
+		memcpy (kva, preload, file_page->read_bytes);
+		memset ((uint8_t *) kva + file_page->read_bytes, 0,
+				file_page->zero_bytes);
+		return true;
+	}
+	return file_backed_swap_in (page, kva);
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (file_read_at (file_page->file, kva, file_page->read_bytes,
+				file_page->ofs) != (off_t) file_page->read_bytes)
+		return false;
+	memset ((uint8_t *) kva + file_page->read_bytes, 0, file_page->zero_bytes);
+	return true;
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file. The write holds
+ * filesys_lock like write () does; it nests inside frame_lock, which is
+ * fine because no holder of filesys_lock ever waits for a frame. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (vm_page_is_dirty (page)) {
+		off_t n;
+
+		lock_acquire (&filesys_lock);
+		n = file_write_at (file_page->file, page->frame->kva,
+				file_page->read_bytes, file_page->ofs);
+		lock_release (&filesys_lock);
+		if (n != (off_t) file_page->read_bytes)
+			return false;
+		pml4_set_dirty (page->owner->pml4, page->va, false);
+	}
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	if (page->frame != NULL)
+		file_backed_swap_out (page);
+	vm_unmap_page (page);
+	vm_area_put (page->area);
+}
+
+/* Returns the mapping of the current process that starts at ADDR. */
+static struct mmap_file *
+find_mmap (void *addr) {
+	struct list *mmap_list = &thread_current ()->mmap_list;
+	struct list_elem *e;
+
+	for (e = list_begin (mmap_list); e != list_end (mmap_list);
+			e = list_next (e)) {
+		struct mmap_file *mmap = list_entry (e, struct mmap_file, elem);
+		if (mmap->addr == addr)
+			return mmap;
+	}
+	return NULL;
+}
+
+/* Returns the mapping of the current process that holds all of the LENGTH
+ * bytes at ADDR, or NULL. */
+static struct mmap_file *
+find_mmap_range (void *addr, size_t length) {
+	struct list *mmap_list = &thread_current ()->mmap_list;
+	uint8_t *start = addr, *end = start + length;
+	struct list_elem *e;
+
+	for (e = list_begin (mmap_list); e != list_end (mmap_list);
+			e = list_next (e)) {
+		struct mmap_file *mmap = list_entry (e, struct mmap_file, elem);
+		uint8_t *mstart = mmap->addr, *mend = mstart + mmap->page_cnt * PGSIZE;
+
+		if (start >= mstart && end <= mend && start < end)
+			return mmap;
+	}
+	return NULL;
+}
+
+/* Writes the CNT pages of RUN, dirty pages that are adjacent in one file,
+ * back with a single write through BUF and clears their dirty bits.
+ * Returns false if the file could not take it all; pages not written stay
+ * dirty. */
+static bool
+write_run (struct page **run, size_t cnt, uint8_t *buf) {
+	struct file_page *first = &run[0]->file, *last = &run[cnt - 1]->file;
+	off_t span = last->ofs + last->read_bytes - first->ofs;
+	bool success = true;
+	off_t n;
+
+	if (cnt == 1 || buf == NULL) {
+		for (size_t i = 0; i < cnt; i++)
+			if (!file_backed_swap_out (run[i]))
+				success = false;
+		return success;
+	}
+
+	/* Clear the dirty bits first, so a write racing with the copy is not
+	 * lost. */
+	for (size_t i = 0; i < cnt; i++) {
+		pml4_set_dirty (run[i]->owner->pml4, run[i]->va, false);
+		memcpy (buf + i * PGSIZE, run[i]->frame->kva, PGSIZE);
+	}
+	lock_acquire (&filesys_lock);
+	n = file_write_at (first->file, buf, span, first->ofs);
+	lock_release (&filesys_lock);
+	if (n == span)
+		return true;
+	for (size_t i = 0; i < cnt; i++)
+		pml4_set_dirty (run[i]->owner->pml4, run[i]->va, true);
+	return false;
+}
+
+/* Writes the dirty pages among the PAGE_CNT mapped pages at ADDR of the
+ * current process back to their file. Runs of pages that are adjacent both
+ * in memory and in the file go out with one write each. Returns false if
+ * any of them could not be written. */
+static bool
+writeback_pages (void *addr, size_t page_cnt) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *run[WRITEBACK_BATCH];
+	uint8_t *buf = palloc_get_multiple (0, WRITEBACK_BATCH);
+	bool success = true;
+	size_t cnt = 0;
+
+	lock_acquire (&frame_lock);
+	for (size_t i = 0; i < page_cnt; i++) {
+		struct page *page = spt_find_page (spt, (uint8_t *) addr + i * PGSIZE);
+		bool dirty = page != NULL
+			&& VM_TYPE (page->operations->type) == VM_FILE
+			&& vm_page_is_dirty (page) && page->file.read_bytes > 0;
+
+		/* Close the run unless PAGE continues it. */
+		if (cnt > 0 && (!dirty || cnt == WRITEBACK_BATCH
+					|| run[cnt - 1]->file.read_bytes < PGSIZE
+					|| page->file.file != run[0]->file.file
+					|| page->file.ofs != run[cnt - 1]->file.ofs + PGSIZE)) {
+			if (!write_run (run, cnt, buf))
+				success = false;
+			cnt = 0;
+		}
+		if (dirty)
+			run[cnt++] = page;
+	}
+	if (cnt > 0 && !write_run (run, cnt, buf))
+		success = false;
+	lock_release (&frame_lock);
+
+	palloc_free_multiple (buf, WRITEBACK_BATCH);
+	return success;
+}
+
+/* Removes the first PAGE_CNT pages at ADDR from the current process. */
+static void
+remove_pages (void *addr, size_t page_cnt) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	lock_acquire (&frame_lock);
+	for (size_t i = 0; i < page_cnt; i++) {
+		struct page *page = spt_find_page (spt, (uint8_t *) addr + i * PGSIZE);
+		if (page != NULL)
+			spt_remove_page (spt, page);
+	}
+	lock_release (&frame_lock);
 }
 
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct mmap_file *mmap = malloc (sizeof *mmap);
+	struct vm_area *area;
+	off_t file_len;
+	size_t read_len;
+	uint8_t *upage = addr;
+
+	if (mmap == NULL)
+		return NULL;
+	mmap->file = file_reopen (file);
+	area = vm_area_create ();
+	if (mmap->file == NULL || area == NULL) {
+		file_close (mmap->file);
+		free (area);
+		free (mmap);
+		return NULL;
+	}
+	mmap->addr = addr;
+	mmap->area = area;
+	mmap->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+	file_len = file_length (mmap->file);
+	read_len = offset < file_len ? (size_t) (file_len - offset) : 0;
+	if (read_len > length)
+		read_len = length;
+
+	for (size_t i = 0; i < mmap->page_cnt; i++) {
+		size_t page_read_bytes = read_len < PGSIZE ? read_len : PGSIZE;
+		struct lazy_load_arg *aux = malloc (sizeof *aux);
+
+		if (aux == NULL)
+			goto fail;
+		*aux = (struct lazy_load_arg) {
+			.file = mmap->file,
+			.ofs = offset,
+			.read_bytes = page_read_bytes,
+			.zero_bytes = PGSIZE - page_read_bytes,
+			.area = vm_area_get (area),
+		};
+		if (!vm_alloc_page_with_initializer (VM_FILE, upage, writable,
+					NULL, aux)) {
+			vm_area_put (area);
+			free (aux);
+			goto fail;
+		}
+
+		read_len -= page_read_bytes;
+		offset += PGSIZE;
+		upage += PGSIZE;
+	}
+
+	list_push_back (&thread_current ()->mmap_list, &mmap->elem);
+	return addr;
+
+fail:
+	remove_pages (addr, (upage - (uint8_t *) addr) / PGSIZE);
+	vm_area_put (area);
+	file_close (mmap->file);
+	free (mmap);
+	return NULL;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct mmap_file *mmap = find_mmap (addr);
+
+	if (mmap == NULL)
+		return;
+
+	/* Write back in batches; destroying the pages then finds them clean. */
+	writeback_pages (mmap->addr, mmap->page_cnt);
+	remove_pages (mmap->addr, mmap->page_cnt);
+	list_remove (&mmap->elem);
+	vm_area_put (mmap->area);
+	file_close (mmap->file);
+	free (mmap);
+}
+
+/* Applies ADVICE, one of the MADV_* values, to the LENGTH bytes at ADDR.
+ * The range must lie within a single mapping. Returns true if
+ * successful. */
+bool
+do_madvise (void *addr, size_t length, int advice) {
+	struct mmap_file *mmap = find_mmap_range (addr, length);
+	size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+	if (mmap == NULL || pg_ofs (addr) != 0)
+		return false;
+
+	switch (advice) {
+		case MADV_NORMAL:
+		case MADV_RANDOM:
+		case MADV_SEQUENTIAL:
+			vm_area_advise (mmap->area, advice);
+			return true;
+		case MADV_WILLNEED:
+			vm_populate (addr, page_cnt);
+			return true;
+		case MADV_DONTNEED:
+			/* Dropping pages that could not be written would lose them. */
+			if (!writeback_pages (addr, page_cnt))
+				return false;
+			vm_drop_pages (addr, page_cnt);
+			return true;
+		default:
+			return false;
+	}
+}
+
+/* Writes the dirty pages among the LENGTH bytes at ADDR, which must lie
+ * within a single mapping, back to the file. Returns true if
+ * successful. */
+bool
+do_msync (void *addr, size_t length) {
+	if (pg_ofs (addr) != 0 || find_mmap_range (addr, length) == NULL)
+		return false;
+
+	return writeback_pages (addr, DIV_ROUND_UP (length, PGSIZE));
 }
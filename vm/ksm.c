@@ -0,0 +1,169 @@
+/* ksm.c: Same-page merging of anonymous frames.
+ *
+ * A low priority kernel thread walks the frame table a few frames at a time.
+ * A frame whose checksum did not change since the previous visit is looked
+ * up in a table keyed by checksum, and when memcmp confirms an identical
+ * frame there, all of its pages move onto that frame. Both frames are
+ * write-protected before the compare, as in Linux KSM. A frame mapped by more
+ * than one page is read-only everywhere, so the next write to a merged page
+ * copies it out again through vm_handle_wp (). The table is rebuilt on every
+ * round over the frame table, which bounds how stale its entries get. */
+
+#include "vm/ksm.h"
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+size_t ksm_pages_to_scan = 0;
+unsigned ksm_sleep_ms = 100;
+
+/* Frames with stable contents seen in this round, keyed by checksum. */
+static struct hash stable_table;
+
+/* Next frame to scan. */
+static struct list_elem *ksm_cursor;
+
+/* Statistics. */
+static size_t pages_merged;     /* Pages moved onto a duplicate frame. */
+static size_t pages_unmerged;   /* Merged pages copied out on a write. */
+
+static uint64_t
+frame_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct frame, ksm_elem)->checksum;
+}
+
+static bool
+frame_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct frame, ksm_elem)->checksum
+		< hash_entry (b, struct frame, ksm_elem)->checksum;
+}
+
+static void
+unindex_frame (struct hash_elem *e, void *aux UNUSED) {
+	hash_entry (e, struct frame, ksm_elem)->indexed = false;
+}
+
+/* Returns true if only anonymous pages map FRAME. */
+static bool
+frame_is_mergeable (struct frame *frame) {
+	struct list_elem *e;
+
+	if (frame->pinned || list_empty (&frame->pages))
+		return false;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (VM_TYPE (page->operations->type) != VM_ANON)
+			return false;
+	}
+	return true;
+}
+
+/* Merges FRAME into an identical indexed frame, or indexes it. */
+static void
+scan_frame (struct frame *frame) {
+	uint64_t checksum;
+	struct hash_elem *e;
+	struct frame *dup;
+
+	if (frame->indexed || !frame_is_mergeable (frame))
+		return;
+
+	/* Skip pages that are still being written. */
+	checksum = hash_bytes (frame->kva, PGSIZE);
+	if (checksum != frame->checksum) {
+		frame->checksum = checksum;
+		return;
+	}
+
+	e = hash_insert (&stable_table, &frame->ksm_elem);
+	if (e == NULL) {
+		frame->indexed = true;
+		return;
+	}
+
+	/* Write-protect both frames before comparing them: ksmd may be
+	 * preempted before the merge, and a write in between must fault
+	 * instead of landing in a frame about to be freed or shared. A
+	 * protected frame that stays unmerged is mapped writable again by
+	 * its next write fault. */
+	dup = hash_entry (e, struct frame, ksm_elem);
+	if (frame_is_mergeable (dup)
+			&& vm_protect_frame (dup) && vm_protect_frame (frame)
+			&& !memcmp (dup->kva, frame->kva, PGSIZE))
+		pages_merged += vm_merge_frame (dup, frame);
+}
+
+/* Scans up to CNT frames, starting a new round at the end of the frame
+ * table. */
+static void
+scan_frames (size_t cnt) {
+	lock_acquire (&frame_lock);
+	while (cnt-- > 0) {
+		struct frame *frame;
+
+		if (ksm_cursor == NULL || ksm_cursor == list_end (&frame_table)) {
+			hash_clear (&stable_table, unindex_frame);
+			ksm_cursor = list_begin (&frame_table);
+			if (ksm_cursor == list_end (&frame_table))
+				break;
+		}
+
+		frame = list_entry (ksm_cursor, struct frame, elem);
+		ksm_cursor = list_next (ksm_cursor);
+		scan_frame (frame);
+	}
+	lock_release (&frame_lock);
+}
+
+static void
+ksm_daemon (void *aux UNUSED) {
+	for (;;) {
+		timer_msleep (ksm_sleep_ms);
+		scan_frames (ksm_pages_to_scan);
+	}
+}
+
+/* Starts the merging thread, if enabled. */
+void
+ksm_init (void) {
+	hash_init (&stable_table, frame_hash, frame_less, NULL);
+	ksm_cursor = NULL;
+
+	if (ksm_pages_to_scan > 0)
+		thread_create ("ksmd", PRI_MIN, ksm_daemon, NULL);
+}
+
+/* Drops FRAME from the scan state before it is freed or reused. */
+void
+ksm_forget (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (ksm_cursor == &frame->elem)
+		ksm_cursor = list_next (ksm_cursor);
+	if (frame->indexed) {
+		hash_delete (&stable_table, &frame->ksm_elem);
+		frame->indexed = false;
+	}
+	frame->checksum = 0;
+	frame->merged = false;
+}
+
+/* Counts a write that copied a page out of a merged frame. */
+void
+ksm_note_unmerge (void) {
+	pages_unmerged++;
+}
+
+/* Prints merging statistics. */
+void
+ksm_print_stats (void) {
+	if (ksm_pages_to_scan > 0)
+		printf ("KSM: %zu pages merged, %zu pages unmerged\n",
+				pages_merged, pages_unmerged);
+}
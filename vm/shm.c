@@ -0,0 +1,343 @@
+/* shm.c: Implementation of shared memory segments.
+ *
+ * A segment is anonymous memory mapped writable by every process that
+ * attached it. The pages mapping one page of a segment share a frame,
+ * which the segment remembers so that later faults find it, or a swap slot
+ * once the frame was evicted. Everything here is protected by frame_lock. */
+
+#include <round.h>
+#include <string.h>
+#include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+static bool shm_swap_in (struct page *page, void *kva);
+static bool shm_swap_out (struct page *page);
+static void shm_destroy (struct page *page);
+
+static const struct page_operations shm_ops = {
+	.swap_in = shm_swap_in,
+	.swap_out = shm_swap_out,
+	.destroy = shm_destroy,
+	.type = VM_SHM,
+};
+
+/* Segments created and not freed yet. */
+static struct list shm_segments;
+
+/* Initializes the shared memory subsystem. */
+void
+vm_shm_init (void) {
+	list_init (&shm_segments);
+}
+
+/* Returns the segment with KEY, or NULL. */
+static struct shm_segment *
+find_segment (int key) {
+	struct list_elem *e;
+
+	for (e = list_begin (&shm_segments); e != list_end (&shm_segments);
+			e = list_next (e)) {
+		struct shm_segment *seg = list_entry (e, struct shm_segment, elem);
+		if (seg->key == key)
+			return seg;
+	}
+	return NULL;
+}
+
+/* Frees SEG, its swap slots and the frames it kept. */
+static void
+free_segment (struct shm_segment *seg) {
+	for (size_t i = 0; i < seg->page_cnt; i++) {
+		if (seg->frames[i] != NULL)
+			vm_free_frame (seg->frames[i]);
+		if (seg->slots[i] != SWAP_SLOT_NONE)
+			swap_slot_put (seg->slots[i]);
+	}
+	list_remove (&seg->elem);
+	free (seg->frames);
+	free (seg->slots);
+	free (seg);
+}
+
+/* Creates a segment of SIZE bytes with KEY. It lives until the last
+ * attachment of it is detached, or until the creating process exits if it
+ * was never attached. Returns false if KEY is taken or memory is
+ * exhausted. */
+bool
+shm_create (int key, size_t size) {
+	struct shm_segment *seg;
+	bool success = false;
+
+	lock_acquire (&frame_lock);
+	if (find_segment (key) != NULL)
+		goto done;
+
+	seg = malloc (sizeof *seg);
+	if (seg == NULL)
+		goto done;
+	seg->key = key;
+	seg->page_cnt = DIV_ROUND_UP (size, PGSIZE);
+	seg->attach_cnt = 0;
+	seg->creator = thread_current ()->tid;
+	seg->frames = calloc (seg->page_cnt, sizeof *seg->frames);
+	seg->slots = malloc (seg->page_cnt * sizeof *seg->slots);
+	if (seg->frames == NULL || seg->slots == NULL) {
+		free (seg->frames);
+		free (seg->slots);
+		free (seg);
+		goto done;
+	}
+	for (size_t i = 0; i < seg->page_cnt; i++)
+		seg->slots[i] = SWAP_SLOT_NONE;
+	list_push_back (&shm_segments, &seg->elem);
+	success = true;
+
+done:
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Removes the first PAGE_CNT pages at ADDR from the current process. */
+static void
+remove_pages (void *addr, size_t page_cnt) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	for (size_t i = 0; i < page_cnt; i++) {
+		struct page *page = spt_find_page (spt, (uint8_t *) addr + i * PGSIZE);
+		if (page != NULL)
+			spt_remove_page (spt, page);
+	}
+}
+
+/* Maps SEG at ADDR in the current process. The pages are created directly
+ * rather than through vm_alloc_page(): they have nothing to initialize,
+ * and a fault must find the segment to share its frames. */
+static bool
+attach_segment (struct shm_segment *seg, void *addr) {
+	struct thread *curr = thread_current ();
+	struct shm_attachment *att = malloc (sizeof *att);
+	uint8_t *upage = addr;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (att == NULL)
+		return false;
+
+	for (size_t i = 0; i < seg->page_cnt; i++, upage += PGSIZE) {
+		struct page *page;
+
+		if (spt_find_page (&curr->spt, upage) != NULL
+				|| (page = malloc (sizeof *page)) == NULL)
+			goto fail;
+		*page = (struct page) {
+			.operations = &shm_ops,
+			.va = upage,
+			.owner = curr,
+			.writable = true,
+			.shm = { .seg = seg, .idx = i },
+		};
+		if (!spt_insert_page (&curr->spt, page)) {
+			free (page);
+			goto fail;
+		}
+	}
+
+	att->addr = addr;
+	att->seg = seg;
+	seg->attach_cnt++;
+	list_push_back (&curr->shm_list, &att->elem);
+	return true;
+
+fail:
+	/* Pages did not count in ATTACH_CNT yet, so they are not saved. */
+	remove_pages (addr, (upage - (uint8_t *) addr) / PGSIZE);
+	free (att);
+	return false;
+}
+
+/* Attaches the segment with KEY at page-aligned ADDR of the current
+ * process. Returns ADDR, or NULL if there is no such segment or the pages
+ * are in use. */
+void *
+shm_attach (int key, void *addr) {
+	struct shm_segment *seg;
+	bool success = false;
+
+	lock_acquire (&frame_lock);
+	seg = find_segment (key);
+	if (seg != NULL && pg_ofs (addr) == 0 && addr != NULL
+			&& is_user_vaddr ((uint8_t *) addr + seg->page_cnt * PGSIZE - 1)
+			&& (uint8_t *) addr + seg->page_cnt * PGSIZE > (uint8_t *) addr)
+		success = attach_segment (seg, addr);
+	lock_release (&frame_lock);
+	return success ? addr : NULL;
+}
+
+/* Undoes attachment ATT of the current process, freeing the segment with
+ * its last attachment. */
+static void
+detach_segment (struct shm_attachment *att) {
+	struct shm_segment *seg = att->seg;
+
+	remove_pages (att->addr, seg->page_cnt);
+	list_remove (&att->elem);
+	free (att);
+	if (--seg->attach_cnt == 0)
+		free_segment (seg);
+}
+
+/* Detaches the segment attached at ADDR of the current process. Returns
+ * false if there is none. */
+bool
+shm_detach (void *addr) {
+	struct list *shm_list = &thread_current ()->shm_list;
+	struct list_elem *e;
+	bool success = false;
+
+	lock_acquire (&frame_lock);
+	for (e = list_begin (shm_list); e != list_end (shm_list);
+			e = list_next (e)) {
+		struct shm_attachment *att =
+			list_entry (e, struct shm_attachment, elem);
+		if (att->addr == addr) {
+			detach_segment (att);
+			success = true;
+			break;
+		}
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Detaches every segment of the current process, and frees the segments
+ * it created that nothing ever attached. */
+void
+shm_detach_all (void) {
+	struct thread *curr = thread_current ();
+	struct list *shm_list = &curr->shm_list;
+	struct list_elem *e;
+
+	lock_acquire (&frame_lock);
+	while (!list_empty (shm_list))
+		detach_segment (list_entry (list_front (shm_list),
+					struct shm_attachment, elem));
+	for (e = list_begin (&shm_segments); e != list_end (&shm_segments);) {
+		struct shm_segment *seg = list_entry (e, struct shm_segment, elem);
+
+		e = list_next (e);
+		if (seg->attach_cnt == 0 && seg->creator == curr->tid)
+			free_segment (seg);
+	}
+	lock_release (&frame_lock);
+}
+
+/* Attaches the segments of PARENT to the current process at the same
+ * addresses. */
+bool
+shm_fork (struct thread *parent) {
+	struct list_elem *e;
+	bool success = true;
+
+	lock_acquire (&frame_lock);
+	for (e = list_begin (&parent->shm_list);
+			success && e != list_end (&parent->shm_list); e = list_next (e)) {
+		struct shm_attachment *att =
+			list_entry (e, struct shm_attachment, elem);
+		success = attach_segment (att->seg, att->addr);
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Returns true if a segment attached to T has pages among the SIZE bytes
+ * at ADDR. */
+bool
+shm_overlaps (struct thread *t, void *addr, size_t size) {
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (e = list_begin (&t->shm_list); e != list_end (&t->shm_list);
+			e = list_next (e)) {
+		struct shm_attachment *att =
+			list_entry (e, struct shm_attachment, elem);
+		uint8_t *start = att->addr;
+		uint8_t *end = start + att->seg->page_cnt * PGSIZE;
+
+		if (start < (uint8_t *) addr + size && (uint8_t *) addr < end)
+			return true;
+	}
+	return false;
+}
+
+/* Returns the frame holding the contents of shared PAGE if another
+ * process has it resident or the segment kept it, otherwise NULL. A kept
+ * frame is unpinned, as PAGE is about to map it. */
+struct frame *
+shm_frame (struct page *page) {
+	struct frame *frame = page->shm.seg->frames[page->shm.idx];
+
+	if (frame != NULL && frame->kept)
+		frame->pinned = frame->kept = false;
+	return frame;
+}
+
+/* Returns true if the contents of non-resident shared PAGE are on the swap
+ * disk. */
+bool
+shm_page_swapped (struct page *page) {
+	return page->shm.seg->slots[page->shm.idx] != SWAP_SLOT_NONE;
+}
+
+/* Loads the contents of PAGE into its new frame at KVA: from swap if the
+ * segment page was evicted, zeros if it was never touched. */
+static bool
+shm_swap_in (struct page *page, void *kva) {
+	struct shm_segment *seg = page->shm.seg;
+	size_t idx = page->shm.idx;
+	size_t slot = seg->slots[idx];
+
+	if (slot != SWAP_SLOT_NONE) {
+		swap_read (slot, kva);
+		swap_slot_put (slot);
+		seg->slots[idx] = SWAP_SLOT_NONE;
+	} else
+		memset (kva, 0, PGSIZE);
+	seg->frames[idx] = page->frame;
+	return true;
+}
+
+/* Saves the frame of PAGE, and so of every process mapping it, to swap. */
+static bool
+shm_swap_out (struct page *page) {
+	struct shm_segment *seg = page->shm.seg;
+	size_t idx = page->shm.idx;
+	size_t slot = swap_write_frame (page->frame);
+
+	if (slot == SWAP_SLOT_NONE)
+		return false;
+	seg->slots[idx] = slot;
+	seg->frames[idx] = NULL;
+	return true;
+}
+
+/* Destroys shared PAGE. PAGE will be freed by the caller. The contents
+ * outlive the last mapping as long as another process has the segment
+ * attached, so they are saved to swap then, or, with the swap disk full,
+ * the segment keeps the frame until it is mapped again or freed. */
+static void
+shm_destroy (struct page *page) {
+	struct shm_segment *seg = page->shm.seg;
+	struct frame *frame = page->frame;
+
+	if (frame != NULL
+			&& list_begin (&frame->pages) == list_rbegin (&frame->pages)) {
+		if (seg->attach_cnt > 1 && !shm_swap_out (page)) {
+			vm_unmap_page_keep (page);
+			return;
+		}
+		seg->frames[page->shm.idx] = NULL;
+	}
+	vm_unmap_page (page);
+}
@@ -1,8 +1,60 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/ksm.h"
+
+/* Serializes the frame table, the mapping list of every frame and all
+ * swap_in/swap_out/destroy calls on pages. */
+struct lock frame_lock;
+
+/* Frames holding user pages, in clock order. */
+struct list frame_table;
+
+/* Clock hand of the eviction policy. */
+static struct list_elem *clock_hand;
+
+/* A single frame of zeros shared read-only by every anonymous page that has
+ * been read but never written. It is not in the frame table, so it is never
+ * evicted. */
+static struct frame zero_frame;
+
+/* Frames holding read-only executable text, keyed by their contents, so
+ * that processes running the same program share them. */
+static struct hash text_frames;
+
+size_t fault_around_pages = 8;
+bool vm_stats_enabled;
+bool large_pages_enabled;
+
+/* The reclaim daemon evicts frames in the background whenever fewer than
+ * RECLAIM_LOW user pages are free, until RECLAIM_HIGH are, twice RECLAIM_LOW
+ * unless given. It waits on RECLAIM_COND with frame_lock, and faults on a
+ * frame it is writing out wait on WRITEBACK_COND. */
+size_t reclaim_low;
+size_t reclaim_high;
+static struct condition reclaim_cond;
+static struct condition writeback_cond;
+
+/* A page belongs to the working set if it was accessed within the last
+ * WS_INTERVAL ticks. */
+#define WS_INTERVAL TIMER_FREQ
+
+/* Smallest resident limit: one instruction may touch its code page, a
+ * stack page and two pages of data, and must be able to run. */
+#define RSS_LIMIT_MIN 4
+
+static void reclaim_daemon (void *aux);
+static uint64_t text_hash (const struct hash_elem *e, void *aux);
+static bool text_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -15,7 +67,27 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	lock_init (&frame_lock);
+	list_init (&frame_table);
+	clock_hand = NULL;
+
+	zero_frame.kva = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	zero_frame.page = NULL;
+	list_init (&zero_frame.pages);
+
+	hash_init (&text_frames, text_hash, text_less, NULL);
+	pml4_share_init ();
+	ksm_init ();
+	vm_shm_init ();
+
+	cond_init (&reclaim_cond);
+	cond_init (&writeback_cond);
+	if (reclaim_high == 0)
+		reclaim_high = 2 * reclaim_low;
+	if (reclaim_high < reclaim_low)
+		reclaim_high = reclaim_low;
+	if (reclaim_low > 0)
+		thread_create ("reclaimd", PRI_DEFAULT, reclaim_daemon, NULL);
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -36,6 +108,17 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static bool vm_map_page (struct page *page);
+static void frame_init (struct frame *frame);
+
+/* Returns the process whose address space the current thread runs on:
+ * the vfork () parent until the child execs or exits, itself otherwise. */
+static struct thread *
+vm_space_owner (void) {
+	struct thread *curr = thread_current ();
+
+	return curr->vfork_parent != NULL ? curr->vfork_parent : curr;
+}
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -46,98 +129,1161 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	ASSERT (VM_TYPE(type) != VM_UNINIT)
 
-	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct supplemental_page_table *spt = &vm_space_owner ()->spt;
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		page = malloc (sizeof *page);
+		if (page == NULL)
+			goto err;
 
-		/* TODO: Insert the page into the spt. */
+		uninit_new (page, pg_round_down (upage), init, type, aux, initializer);
+		page->owner = vm_space_owner ();
+		page->writable = writable;
+		page->area = NULL;
+		page->prefetched = false;
+
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
+static size_t vm_area_window (struct vm_area *area);
+
+/* Creates an area holding one reference for the caller. Returns NULL if
+ * memory is exhausted. */
+struct vm_area *
+vm_area_create (void) {
+	struct vm_area *area = malloc (sizeof *area);
+
+	if (area != NULL) {
+		area->advice = MADV_NORMAL;
+		area->fault_around = vm_area_window (area);
+		area->refs = 1;
+	}
+	return area;
+}
+
+/* Returns the largest fault-around window AREA may use. */
+static size_t
+vm_area_window (struct vm_area *area) {
+	switch (area->advice) {
+		case MADV_RANDOM:
+			return 1;
+		case MADV_SEQUENTIAL:
+			return FAULT_AROUND_MAX;
+		default:
+			if (fault_around_pages < 1)
+				return 1;
+			return fault_around_pages < FAULT_AROUND_MAX
+				? fault_around_pages : FAULT_AROUND_MAX;
+	}
+}
+
+/* Sets the access pattern expected for AREA to ADVICE, one of MADV_NORMAL,
+ * MADV_RANDOM and MADV_SEQUENTIAL. */
+void
+vm_area_advise (struct vm_area *area, int advice) {
+	lock_acquire (&frame_lock);
+	area->advice = advice;
+	area->fault_around = vm_area_window (area);
+	lock_release (&frame_lock);
+}
+
+/* Adds a reference to AREA and returns it. */
+struct vm_area *
+vm_area_get (struct vm_area *area) {
+	if (area != NULL)
+		area->refs++;
+	return area;
+}
+
+/* Drops a reference to AREA, freeing it with the last one. */
+void
+vm_area_put (struct vm_area *area) {
+	if (area != NULL && --area->refs == 0)
+		free (area);
+}
+
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page key;
+	struct hash_elem *e;
 
-	return page;
+	key.va = pg_round_down (va);
+	e = hash_find (&spt->pages, &key.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
-
-	return succ;
+spt_insert_page (struct supplemental_page_table *spt,
+		struct page *page) {
+	return hash_insert (&spt->pages, &page->spt_elem) == NULL;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	hash_delete (&spt->pages, &page->spt_elem);
 	vm_dealloc_page (page);
+}
+
+/* Returns true if more than one page maps FRAME. */
+static bool
+frame_is_shared (struct frame *frame) {
+	return frame == &zero_frame
+		|| list_begin (&frame->pages) != list_rbegin (&frame->pages);
+}
+
+/* Returns true if PAGE was accessed since the last call, clearing its
+ * accessed bit on the way. An access found by vm_working_set () counts. */
+static bool
+page_test_and_clear_accessed (struct page *page) {
+	uint64_t *pml4 = page->owner->pml4;
+	bool accessed = page->referenced;
+
+	page->referenced = false;
+	if (pml4_is_accessed (pml4, page->va)) {
+		pml4_set_accessed (pml4, page->va, false);
+		page->used_at = timer_ticks ();
+		accessed = true;
+	}
+	return accessed;
+}
+
+/* Returns true if any page mapping FRAME was accessed since the last call,
+ * clearing the accessed bits on the way. */
+static bool
+frame_test_and_clear_accessed (struct frame *frame) {
+	bool accessed = false;
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+
+		if (page_test_and_clear_accessed (page)) {
+			accessed = true;
+			if (page->prefetched) {
+				/* Fault-around paid off: widen the window again. */
+				if (page->area->fault_around < vm_area_window (page->area))
+					page->area->fault_around++;
+				page->prefetched = false;
+			}
+		}
+	}
+	return accessed;
+}
+
+/* Takes FRAME out of the frame table, moving the scanners past it. */
+static void
+frame_table_remove (struct frame *frame) {
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	ksm_forget (frame);
+	if (frame->text) {
+		hash_delete (&text_frames, &frame->text_elem);
+		frame->text = false;
+	}
+	list_remove (&frame->elem);
+}
+
+static uint64_t
+text_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct frame *frame = hash_entry (e, struct frame, text_elem);
+	return hash_bytes (&frame->text_key, sizeof frame->text_key);
+}
+
+static bool
+text_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	const struct frame *fa = hash_entry (a, struct frame, text_elem);
+	const struct frame *fb = hash_entry (b, struct frame, text_elem);
+	return memcmp (&fa->text_key, &fb->text_key, sizeof fa->text_key) < 0;
+}
+
+/* Returns true if PAGE is read-only text of its owner's executable, storing
+ * the identity of its contents in KEY. The executable cannot be written
+ * while it runs, so every such page with the same KEY holds the same data. */
+static bool
+vm_text_key (struct page *page, struct text_key *key) {
+	struct file *file;
+
+	if (page->writable || page_get_type (page) != VM_FILE)
+		return false;
+
+	memset (key, 0, sizeof *key);
+	if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+		struct lazy_load_arg *arg = page->uninit.aux;
+		file = arg->file;
+		key->ofs = arg->ofs;
+		key->read_bytes = arg->read_bytes;
+	} else {
+		file = page->file.file;
+		key->ofs = page->file.ofs;
+		key->read_bytes = page->file.read_bytes;
+	}
+	if (file == NULL || file != page->owner->running_file)
+		return false;
+	key->inode = inode_get_inumber (file_get_inode (file));
 	return true;
 }
 
+/* Returns the frame already holding the text of PAGE, or NULL. */
+static struct frame *
+vm_text_lookup (struct page *page) {
+	struct frame key;
+	struct hash_elem *e;
+
+	if (!vm_text_key (page, &key.text_key))
+		return NULL;
+	e = hash_find (&text_frames, &key.text_elem);
+	return e != NULL ? hash_entry (e, struct frame, text_elem) : NULL;
+}
+
+/* Publishes the frame of text PAGE for other processes to map. */
+static void
+vm_text_insert (struct page *page) {
+	struct frame *frame = page->frame;
+
+	if (frame->text || !vm_text_key (page, &frame->text_key))
+		return;
+	frame->text = hash_insert (&text_frames, &frame->text_elem) == NULL;
+}
+
 /* Get the struct frame, that will be evicted. */
 static struct frame *
 vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	size_t scanned = 0, limit = 2 * list_size (&frame_table);
 
-	return victim;
+	/* Clock: give every recently accessed frame a second chance. */
+	while (scanned++ <= limit) {
+		struct frame *frame;
+
+		if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+		if (clock_hand == list_end (&frame_table))
+			break;
+
+		frame = list_entry (clock_hand, struct frame, elem);
+		clock_hand = list_next (clock_hand);
+		if (frame->pinned)
+			continue;
+		if (!frame_test_and_clear_accessed (frame))
+			return frame;
+	}
+	return NULL;
+}
+
+/* Writes out VICTIM and takes it away from every page mapping it. Returns
+ * false if the contents could not be saved. */
+static bool
+vm_evict (struct frame *victim) {
+	struct page *page;
+	struct list_elem *e;
+
+	/* Save the contents once, then let the other mappers of a shared frame
+	 * refer to the same copy. */
+	page = list_entry (list_front (&victim->pages), struct page, frame_elem);
+	if (!swap_out (page))
+		return false;
+	for (e = list_next (&page->frame_elem); e != list_end (&victim->pages);
+			e = list_next (e)) {
+		struct page *sharer = list_entry (e, struct page, frame_elem);
+		if (page_get_type (sharer) == VM_ANON)
+			anon_share_swap (sharer, page);
+	}
+
+	while (!list_empty (&victim->pages)) {
+		struct page *sharer = list_entry (list_pop_front (&victim->pages),
+				struct page, frame_elem);
+		pml4_clear_page (sharer->owner->pml4, sharer->va);
+		sharer->frame = NULL;
+		list_remove (&sharer->resident_elem);
+		sharer->owner->vmstat.rss--;
+		sharer->owner->vmstat.evicted++;
+
+		/* Mapped around a fault and never used: read less next time. */
+		if (sharer->prefetched && sharer->area->fault_around > 1)
+			sharer->area->fault_around /= 2;
+		sharer->prefetched = false;
+	}
+
+	frame_table_remove (victim);
+	victim->page = NULL;
+	return true;
 }
 
 /* Evict one page and return the corresponding frame.
  * Return NULL on error.*/
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct frame *victim = vm_get_victim ();
 
-	return NULL;
+	if (victim == NULL || !vm_evict (victim))
+		return NULL;
+	return victim;
+}
+
+/* Evicts and frees a frame of OWNER, chosen by a clock over its resident
+ * pages, so that a process at its resident limit pages against itself.
+ * Frames other processes map as well are left alone. Returns false if
+ * there was nothing to evict. */
+static bool
+vm_evict_local (struct thread *owner) {
+	struct list *resident = &owner->spt.resident;
+	size_t scanned = 0, limit = 2 * list_size (resident);
+
+	while (scanned++ < limit) {
+		struct page *page = list_entry (list_pop_front (resident),
+				struct page, resident_elem);
+		struct frame *frame = page->frame;
+
+		list_push_back (resident, &page->resident_elem);
+		if (frame_is_shared (frame) || frame->pinned
+				|| frame_test_and_clear_accessed (frame))
+			continue;
+		if (!vm_evict (frame))
+			return false;
+		palloc_free_page (frame->kva);
+		free (frame);
+		return true;
+	}
+	return false;
+}
+
+/* Evicts pages of OWNER until at most TARGET are resident, or nothing more
+ * can be evicted. */
+static void
+vm_shrink_resident (struct thread *owner, size_t target) {
+	while (owner->vmstat.rss > target && vm_evict_local (owner))
+		continue;
+}
+
+/* Resets FRAME, which holds KVA already, to a frame that nothing maps. */
+static void
+frame_init (struct frame *frame) {
+	frame->page = NULL;
+	frame->pinned = false;
+	frame->kept = false;
+	frame->writeback = false;
+	frame->swap_slot = SWAP_SLOT_NONE;
+	frame->checksum = 0;
+	frame->indexed = false;
+	frame->merged = false;
+	frame->text = false;
+	list_init (&frame->pages);
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space. Returns NULL only if nothing could be evicted. */
 static struct frame *
 vm_get_frame (void) {
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	void *kva = palloc_get_page (PAL_USER);
+
+	if (palloc_user_free_cnt () < reclaim_low)
+		cond_signal (&reclaim_cond, &frame_lock);
+
+	if (kva == NULL)
+		frame = vm_evict_frame ();
+	else {
+		frame = malloc (sizeof *frame);
+		if (frame == NULL) {
+			palloc_free_page (kva);
+			return NULL;
+		}
+		frame->kva = kva;
+	}
+	if (frame == NULL)
+		return NULL;
 
+	frame_init (frame);
 	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
-/* Growing the stack. */
+/* Writes out the contents of VICTIM, which the clock chose, as swap_out ()
+ * would, but with frame_lock released for the write. VICTIM is pinned
+ * and write-protected meanwhile, so that nothing evicts or changes it;
+ * faults on it wait on WRITEBACK_COND. Returns true if VICTIM may now be
+ * evicted without writing, false if it stays. Frees VICTIM, unless a
+ * segment kept it, and returns false if its pages went away meanwhile. */
+static bool
+vm_write_out (struct frame *victim) {
+	struct page *page = list_entry (list_front (&victim->pages),
+			struct page, frame_elem);
+	struct file *file = NULL;
+	size_t slot = SWAP_SLOT_NONE;
+	off_t ofs = 0, bytes = 0;
+	bool written;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (page_get_type (page) == VM_FILE) {
+		if (!vm_page_is_dirty (page))
+			return true;
+		lock_acquire (&filesys_lock);
+		file = file_reopen (page->file.file);
+		lock_release (&filesys_lock);
+		if (file == NULL)
+			return false;
+		ofs = page->file.ofs;
+		bytes = page->file.read_bytes;
+	}
+	if (!vm_protect_frame (victim)) {
+		if (file != NULL) {
+			lock_acquire (&filesys_lock);
+			file_close (file);
+			lock_release (&filesys_lock);
+		}
+		return false;
+	}
+
+	victim->pinned = victim->writeback = true;
+	lock_release (&frame_lock);
+	if (file != NULL) {
+		lock_acquire (&filesys_lock);
+		written = file_write_at (file, victim->kva, bytes, ofs) == bytes;
+		file_close (file);
+		lock_release (&filesys_lock);
+	} else
+		written = (slot = swap_write (victim->kva)) != SWAP_SLOT_NONE;
+	lock_acquire (&frame_lock);
+	victim->writeback = false;
+	cond_broadcast (&writeback_cond, &frame_lock);
+
+	if (list_empty (&victim->pages)) {
+		if (slot != SWAP_SLOT_NONE)
+			swap_slot_put (slot);
+		if (!victim->kept)
+			vm_free_frame (victim);
+		return false;
+	}
+	victim->pinned = false;
+	if (!written)
+		return false;
+
+	if (file != NULL) {
+		struct list_elem *e;
+
+		/* Written back: swap_out () has nothing left to write. */
+		for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+				e = list_next (e)) {
+			struct page *sharer = list_entry (e, struct page, frame_elem);
+			if (page_get_type (sharer) == VM_FILE)
+				pml4_set_dirty (sharer->owner->pml4, sharer->va, false);
+		}
+	} else
+		victim->swap_slot = slot;
+	return true;
+}
+
+/* Keeps at least RECLAIM_LOW user pages free, so that faults rarely have
+ * to write a victim out themselves. Victims are chosen with frame_lock
+ * held, and written out without it. */
+static void
+reclaim_daemon (void *aux UNUSED) {
+	lock_acquire (&frame_lock);
+	for (;;) {
+		while (palloc_user_free_cnt () >= reclaim_low)
+			cond_wait (&reclaim_cond, &frame_lock);
+
+		while (palloc_user_free_cnt () < reclaim_high) {
+			struct frame *frame = vm_get_victim ();
+			bool evicted;
+
+			if (frame == NULL || !vm_write_out (frame))
+				break;
+			evicted = vm_evict (frame);
+			if (frame->swap_slot != SWAP_SLOT_NONE) {
+				/* Written for a page swap_out () did not save to swap. */
+				swap_slot_put (frame->swap_slot);
+				frame->swap_slot = SWAP_SLOT_NONE;
+			}
+			if (!evicted)
+				break;
+			palloc_free_page (frame->kva);
+			free (frame);
+		}
+
+		/* Nothing left to evict: wait for the next signal. */
+		if (palloc_user_free_cnt () < reclaim_low)
+			cond_wait (&reclaim_cond, &frame_lock);
+	}
+}
+
+/* Removes FRAME from the frame table and releases it. */
+void
+vm_free_frame (struct frame *frame) {
+	ASSERT (list_empty (&frame->pages));
+
+	frame_table_remove (frame);
+	palloc_free_page (frame->kva);
+	free (frame);
+}
+
+/* Links PAGE to FRAME. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+vm_link_page (struct page *page, struct frame *frame) {
+	if (page->frame == NULL) {
+		page->owner->vmstat.rss++;
+		list_push_back (&page->owner->spt.resident, &page->resident_elem);
+		page->used_at = timer_ticks ();
+		page->referenced = false;
+	}
+	if (frame->page == NULL)
+		frame->page = page;
+	page->frame = frame;
+	if (frame != &zero_frame)
+		list_push_back (&frame->pages, &page->frame_elem);
+}
+
+/* Maps PAGE to its frame in the owner's page table. A page whose frame is
+ * shared is mapped read-only, so that the first write to it reaches
+ * vm_handle_wp (), unless the sharing is the point of the page; so is one
+ * whose frame is being written out. */
+static bool
+vm_map_page (struct page *page) {
+	bool rw = page->writable && !page->frame->writeback
+		&& (!frame_is_shared (page->frame)
+			|| page_get_type (page) == VM_SHM);
+
+	return pml4_set_page (page->owner->pml4, page->va, page->frame->kva, rw);
+}
+
+/* Detaches PAGE from its frame and removes its mapping. The frame is freed
+ * when no other page maps it, unless KEEP is true: then it stays in the
+ * frame table, pinned, for the caller to free or map again. One the
+ * reclaim daemon is writing out is left for it to free. */
+static void
+unmap_page (struct page *page, bool keep) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame == NULL)
+		return;
+
+	if (page->owner->pml4 != NULL)
+		pml4_clear_page (page->owner->pml4, page->va);
+	page->frame = NULL;
+	list_remove (&page->resident_elem);
+	page->owner->vmstat.rss--;
+	if (frame == &zero_frame)
+		return;
+
+	list_remove (&page->frame_elem);
+	if (list_empty (&frame->pages) && keep) {
+		frame->page = NULL;
+		frame->pinned = frame->kept = true;
+	} else if (list_empty (&frame->pages) && frame->writeback)
+		frame->page = NULL;
+	else if (list_empty (&frame->pages))
+		vm_free_frame (frame);
+	else if (frame->page == page)
+		frame->page = list_entry (list_front (&frame->pages),
+				struct page, frame_elem);
+}
+
+/* Detaches PAGE from its frame and removes its mapping. The frame is freed
+ * when no other page maps it. */
+void
+vm_unmap_page (struct page *page) {
+	unmap_page (page, false);
+}
+
+/* Like vm_unmap_page (), but keeps the frame when nothing maps it any
+ * more, pinned so that it is not evicted with no page to save it. */
+void
+vm_unmap_page_keep (struct page *page) {
+	unmap_page (page, true);
+}
+
+/* Maps every page of FRAME read-only, so that no write reaches the frame
+ * until vm_handle_wp () maps the page again. Returns false if a mapping
+ * could not be changed. */
+bool
+vm_protect_frame (struct frame *frame) {
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+
+		if (page->owner->pml4 != NULL
+				&& !pml4_set_page (page->owner->pml4, page->va, frame->kva,
+					false))
+			return false;
+	}
+	return true;
+}
+
+/* Moves every page mapping SRC over to DST, which holds the same
+ * contents, and frees SRC. Both must be write-protected with
+ * vm_protect_frame () before their contents are compared. Returns the
+ * number of pages moved. */
+size_t
+vm_merge_frame (struct frame *dst, struct frame *src) {
+	size_t cnt = 0;
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (dst != src);
+
+	while (!list_empty (&src->pages)) {
+		struct page *page = list_entry (list_pop_front (&src->pages),
+				struct page, frame_elem);
+		vm_link_page (page, dst);
+		cnt++;
+	}
+	src->page = NULL;
+	vm_free_frame (src);
+
+	/* DST is shared now, so every mapping of it becomes read-only. An
+	 * exiting owner that dropped its page table has none to change. A
+	 * mapping that cannot be changed is removed, to fault back in. */
+	for (e = list_begin (&dst->pages); e != list_end (&dst->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+
+		if (page->owner->pml4 != NULL && !vm_map_page (page))
+			pml4_clear_page (page->owner->pml4, page->va);
+	}
+	dst->merged = true;
+	return cnt;
+}
+
+/* Returns true if the user wrote to PAGE since it was mapped. */
+bool
+vm_page_is_dirty (struct page *page) {
+	return page->frame != NULL
+		&& pml4_is_dirty (page->owner->pml4, page->va);
+}
+
+/* Returns true if ADDR is a valid stack access for a thread whose user stack
+ * pointer is RSP. PUSH may write 8 bytes below the stack pointer. */
+static bool
+vm_is_stack_access (void *addr, void *rsp) {
+	return (uint8_t *) addr >= (uint8_t *) rsp - 8
+		&& (uint8_t *) addr < (uint8_t *) USER_STACK
+		&& (uint8_t *) addr >= (uint8_t *) USER_STACK - STACK_LIMIT;
+}
+
+/* Growing the stack. */
+static bool
+vm_stack_growth (void *addr) {
+	void *stack_page = pg_round_down (addr);
+
+	return vm_alloc_page (VM_ANON | VM_STACK, stack_page, true)
+		&& vm_do_claim_page (spt_find_page (&vm_space_owner ()->spt,
+					stack_page));
 }
 
 /* Handle the fault on write_protected page */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	struct frame *old = page->frame;
+	struct frame *frame;
+
+	if (!page->writable || old == NULL)
+		return false;
+
+	/* Last page left on the frame: the frame is private now. Shared memory
+	 * is written in place. */
+	if (!frame_is_shared (old) || page_get_type (page) == VM_SHM)
+		return vm_map_page (page);
+
+	if (old->merged)
+		ksm_note_unmerge ();
+
+	/* Copy on write. Pin the old frame so that getting a new frame does not
+	 * evict it under us. */
+	old->pinned = true;
+	frame = vm_get_frame ();
+	old->pinned = false;
+	if (frame == NULL)
+		return false;
+
+	if (old == &zero_frame)
+		memset (frame->kva, 0, PGSIZE);
+	else
+		memcpy (frame->kva, old->kva, PGSIZE);
+
+	vm_unmap_page (page);
+	vm_link_page (page, frame);
+	list_push_back (&frame_table, &frame->elem);
+	page->owner->vmstat.cow_faults++;
+	return vm_map_page (page);
+}
+
+/* Returns true if PAGE is an anonymous page that was never touched, so its
+ * contents are all zeros. */
+static bool
+vm_is_untouched_anon (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->uninit.init == NULL;
+}
+
+/* Maps the shared zero frame read-only at PAGE, turning the page into an
+ * anonymous page without giving it a frame of its own. The first write
+ * allocates the private frame through vm_handle_wp (). */
+static bool
+vm_map_zero_page (struct page *page) {
+	if (!swap_in (page, NULL))
+		return false;
+	vm_link_page (page, &zero_frame);
+	if (!vm_map_page (page)) {
+		vm_unmap_page (page);
+		return false;
+	}
+	return true;
+}
+
+/* Maps PAGE to the frame of another process that already holds its
+ * contents: executable text or a page of shared memory. Returns false if
+ * there is none. */
+static bool
+vm_share_page (struct page *page) {
+	struct frame *frame = page_get_type (page) == VM_SHM
+		? shm_frame (page) : vm_text_lookup (page);
+
+	if (frame == NULL)
+		return false;
+
+	/* An uninit page becomes a file page without reading anything. */
+	if (VM_TYPE (page->operations->type) == VM_UNINIT
+			&& !swap_in (page, NULL))
+		return false;
+	vm_link_page (page, frame);
+	if (!vm_map_page (page)) {
+		/* A frame the segment kept stays with it. */
+		if (page_get_type (page) == VM_SHM)
+			vm_unmap_page_keep (page);
+		else
+			vm_unmap_page (page);
+		return false;
+	}
+	return true;
+}
+
+/* Returns the load descriptor of PAGE if it is a file-backed page that was
+ * never loaded, otherwise NULL. */
+static struct lazy_load_arg *
+vm_lazy_file_arg (struct page *page) {
+	if (page == NULL || page->frame != NULL
+			|| VM_TYPE (page->operations->type) != VM_UNINIT)
+		return NULL;
+	return page->uninit.aux;
+}
+
+/* Returns true if NEIGHBOR is a page of the same area as PAGE, described by
+ * ARG, that is not loaded yet and whose contents follow on in the file. */
+static bool
+vm_is_fault_around_page (struct page *neighbor, struct page *page,
+		struct lazy_load_arg *arg) {
+	struct lazy_load_arg *narg = vm_lazy_file_arg (neighbor);
+
+	return narg != NULL && narg->area == arg->area && narg->file == arg->file
+		&& narg->ofs - arg->ofs
+			== (uint8_t *) neighbor->va - (uint8_t *) page->va
+		&& vm_text_lookup (neighbor) == NULL;
+}
+
+/* Claims the CNT consecutive pages of RUN, file pages of one area that were
+ * never loaded, reading their file contents with a single read. RUN[IDX]
+ * is claimed first and stays pinned while the others are filled; those are
+ * marked as prefetched if PREFETCH. Returns true if RUN[IDX] was claimed. */
+static bool
+vm_claim_run (struct page **run, size_t cnt, size_t idx, bool prefetch) {
+	struct lazy_load_arg *args[FAULT_AROUND_MAX];
+	struct page *page = run[idx];
+	off_t span;
+	uint8_t *buf;
+	bool success;
+
+	ASSERT (cnt <= FAULT_AROUND_MAX);
+
+	if (cnt == 1)
+		return vm_do_claim_page (page);
+
+	for (size_t i = 0; i < cnt; i++)
+		args[i] = run[i]->uninit.aux;
+
+	span = args[cnt - 1]->ofs + args[cnt - 1]->read_bytes - args[0]->ofs;
+	buf = palloc_get_multiple (0, cnt);
+	if (buf == NULL)
+		return vm_do_claim_page (page);
+	if (file_read_at (args[0]->file, buf, span, args[0]->ofs) != span) {
+		palloc_free_multiple (buf, cnt);
+		return vm_do_claim_page (page);
+	}
+
+	/* The initializers copy from the buffer instead of reading. */
+	args[idx]->preload = buf + idx * PGSIZE;
+	success = vm_do_claim_page (page);
+	if (success) {
+		page->frame->pinned = true;
+		for (size_t i = 0; i < cnt; i++) {
+			if (i == idx)
+				continue;
+			args[i]->preload = buf + i * PGSIZE;
+			if (vm_do_claim_page (run[i]))
+				run[i]->prefetched = prefetch;
+			else if (VM_TYPE (run[i]->operations->type) == VM_UNINIT)
+				args[i]->preload = NULL;
+		}
+		page->frame->pinned = false;
+	} else if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		args[idx]->preload = NULL;
+
+	palloc_free_multiple (buf, cnt);
+	return success;
+}
+
+/* Writes file PAGE back if it is dirty and releases its frame, so that the
+ * next access reads it again. Clean pages cost no I/O. Pages on a shared or
+ * pinned frame are left alone. */
+static void
+vm_drop_page (struct page *page) {
+	if (page == NULL || page->frame == NULL
+			|| VM_TYPE (page->operations->type) != VM_FILE
+			|| frame_is_shared (page->frame) || page->frame->pinned)
+		return;
+	if (swap_out (page))
+		vm_unmap_page (page);
+}
+
+/* Claims file-backed PAGE together with the pages of its area around it
+ * that are not present yet, up to the area's fault-around window. */
+static bool
+vm_fault_around (struct page *page) {
+	struct supplemental_page_table *spt = &page->owner->spt;
+	struct lazy_load_arg *arg = page->uninit.aux;
+	struct vm_area *area = arg->area;
+	struct page *run[FAULT_AROUND_MAX];
+	size_t window = area->fault_around;
+	uint8_t *va = page->va, *lo = va, *hi = va + PGSIZE, *start;
+	size_t cnt;
+
+	/* Consider the aligned window around the faulting page. */
+	start = va - pg_no (va) % window * PGSIZE;
+	while (lo > start && vm_is_fault_around_page (
+				spt_find_page (spt, lo - PGSIZE), page, arg))
+		lo -= PGSIZE;
+	while (hi < start + window * PGSIZE && vm_is_fault_around_page (
+				spt_find_page (spt, hi), page, arg))
+		hi += PGSIZE;
+
+	cnt = (hi - lo) / PGSIZE;
+	for (size_t i = 0; i < cnt; i++)
+		run[i] = spt_find_page (spt, lo + i * PGSIZE);
+
+	/* Sequential access will not come back: drop the window before last
+	 * from memory. */
+	if (area->advice == MADV_SEQUENTIAL
+			&& (uintptr_t) lo >= 2 * window * PGSIZE) {
+		for (uint8_t *old = lo - 2 * window * PGSIZE;
+				old < lo - window * PGSIZE; old += PGSIZE) {
+			struct page *behind = spt_find_page (spt, old);
+			if (behind != NULL && behind->area == area)
+				vm_drop_page (behind);
+		}
+	}
+
+	return vm_claim_run (run, cnt, (va - lo) / PGSIZE, true);
+}
+
+/* Loads the not present pages of the PAGE_CNT pages at ADDR of the current
+ * process, with one read for each run of consecutive file pages. */
+void
+vm_populate (void *addr, size_t page_cnt) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *va = addr, *end = va + page_cnt * PGSIZE;
+
+	lock_acquire (&frame_lock);
+	while (va < end) {
+		struct page *run[FAULT_AROUND_MAX];
+		struct lazy_load_arg *arg;
+		size_t cnt = 1;
+
+		run[0] = spt_find_page (spt, va);
+		if (run[0] == NULL || run[0]->frame != NULL) {
+			va += PGSIZE;
+			continue;
+		}
+
+		arg = vm_lazy_file_arg (run[0]);
+		if (arg == NULL) {
+			/* Loaded before and evicted since. */
+			vm_do_claim_page (run[0]);
+			va += PGSIZE;
+			continue;
+		}
+		while (cnt < FAULT_AROUND_MAX && va + cnt * PGSIZE < end) {
+			struct page *next = spt_find_page (spt, va + cnt * PGSIZE);
+			if (!vm_is_fault_around_page (next, run[0], arg))
+				break;
+			run[cnt++] = next;
+		}
+		vm_claim_run (run, cnt, 0, false);
+		va += cnt * PGSIZE;
+	}
+	lock_release (&frame_lock);
+}
+
+/* Drops the resident file pages among the PAGE_CNT pages at ADDR of the
+ * current process, writing back only the dirty ones. */
+void
+vm_drop_pages (void *addr, size_t page_cnt) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	lock_acquire (&frame_lock);
+	for (size_t i = 0; i < page_cnt; i++)
+		vm_drop_page (spt_find_page (spt, (uint8_t *) addr + i * PGSIZE));
+	lock_release (&frame_lock);
+}
+
+/* Limits the current process to PAGE_CNT resident pages, at least
+ * RSS_LIMIT_MIN, or lifts the limit if PAGE_CNT is 0, evicting its own
+ * pages down to a new limit. Children inherit the limit and exec keeps it.
+ * Returns the previous limit. */
+size_t
+vm_set_rss_limit (size_t page_cnt) {
+	struct thread *curr = thread_current ();
+	size_t old;
+
+	if (page_cnt != 0 && page_cnt < RSS_LIMIT_MIN)
+		page_cnt = RSS_LIMIT_MIN;
+
+	lock_acquire (&frame_lock);
+	old = curr->rss_limit;
+	curr->rss_limit = page_cnt;
+	if (page_cnt != 0)
+		vm_shrink_resident (curr, page_cnt);
+	lock_release (&frame_lock);
+	return old;
+}
+
+/* Estimates the working set of the current process: its resident pages
+ * accessed within the last WS_INTERVAL ticks. The accessed bits sampled
+ * here are passed on to the clock through the pages' REFERENCED flag.
+ * Those in page tables fork left shared are read but not cleared, which
+ * would clear them for the other processes too. */
+size_t
+vm_working_set (void) {
+	struct thread *curr = thread_current ();
+	int64_t now = timer_ticks ();
+	size_t cnt = 0;
+	struct list_elem *e;
+
+	lock_acquire (&frame_lock);
+	for (e = list_begin (&curr->spt.resident);
+			e != list_end (&curr->spt.resident); e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, resident_elem);
+
+		if (pml4_is_accessed (curr->pml4, page->va)) {
+			if (!pml4_is_shared (curr->pml4, page->va))
+				pml4_set_accessed (curr->pml4, page->va, false);
+			page->referenced = true;
+			page->used_at = now;
+		}
+		if (now - page->used_at < WS_INTERVAL)
+			cnt++;
+	}
+	lock_release (&frame_lock);
+	return cnt;
+}
+
+/* Returns true if PAGE may be backed by part of a large page. */
+static bool
+vm_is_large_page_part (struct page *page) {
+	return page != NULL && page->writable && vm_is_untouched_anon (page)
+		&& !(page->uninit.type & VM_STACK);
+}
+
+/* Backs the LARGE_PGCNT pages of the aligned range around untouched
+ * anonymous PAGE, if they are all such pages, with physically contiguous
+ * frames mapped by a single large page. Each part is an ordinary frame;
+ * evicting or unmapping one splits the large page. Returns false, leaving
+ * the pages alone, if large pages are disabled or no run of frames is
+ * free. If a part cannot be filled, those filled before it are kept as
+ * small pages, and PAGE is mapped alone if it is one of them. */
+static bool
+vm_claim_large (struct page *page) {
+	struct supplemental_page_table *spt = &page->owner->spt;
+	uint8_t *base = (uint8_t *) ((uintptr_t) page->va & ~(LARGE_PGSIZE - 1));
+	struct list frames;
+	uint8_t *kva;
+	size_t i;
+
+	if (!large_pages_enabled || !vm_is_large_page_part (page))
+		return false;
+	/* Would overrun the resident limit. */
+	if (page->owner->rss_limit != 0
+			&& page->owner->vmstat.rss + LARGE_PGCNT > page->owner->rss_limit)
+		return false;
+
+	/* Check the last page first: regions tend to end inside the range. */
+	if (!vm_is_large_page_part (spt_find_page (spt,
+					base + LARGE_PGSIZE - PGSIZE)))
+		return false;
+	for (i = 0; i < LARGE_PGCNT; i++)
+		if (!vm_is_large_page_part (spt_find_page (spt, base + i * PGSIZE)))
+			return false;
+
+	/* Never evict for a large page: it is only worth it while memory is
+	 * plentiful. */
+	kva = palloc_get_aligned (PAL_USER, LARGE_PGCNT, LARGE_PGCNT);
+	if (kva == NULL)
+		return false;
+	list_init (&frames);
+	for (i = 0; i < LARGE_PGCNT; i++) {
+		struct frame *frame = malloc (sizeof *frame);
+		if (frame == NULL) {
+			while (!list_empty (&frames))
+				free (list_entry (list_pop_front (&frames), struct frame, elem));
+			palloc_free_multiple (kva, LARGE_PGCNT);
+			return false;
+		}
+		list_push_back (&frames, &frame->elem);
+	}
+	if (palloc_user_free_cnt () < reclaim_low)
+		cond_signal (&reclaim_cond, &frame_lock);
+
+	for (i = 0; i < LARGE_PGCNT; i++) {
+		struct page *part = spt_find_page (spt, base + i * PGSIZE);
+		struct frame *frame = list_entry (list_pop_front (&frames),
+				struct frame, elem);
+
+		frame->kva = kva + i * PGSIZE;
+		frame_init (frame);
+		vm_link_page (part, frame);
+		list_push_back (&frame_table, &frame->elem);
+		if (!swap_in (part, frame->kva)) {
+			vm_unmap_page (part);
+			break;
+		}
+	}
+	if (i < LARGE_PGCNT) {
+		/* Fall back to small pages: the parts filled already keep their
+		 * frames, and the frames of the rest are given back. */
+		while (++i < LARGE_PGCNT) {
+			free (list_entry (list_pop_front (&frames), struct frame, elem));
+			palloc_free_page (kva + i * PGSIZE);
+		}
+	} else if (pml4_set_large_page (page->owner->pml4, base, kva, true))
+		return true;
+
+	/* No large mapping after all: the other parts are mapped as they
+	 * fault. */
+	if (page->frame == NULL)
+		return false;
+	if (vm_map_page (page))
+		return true;
+	vm_unmap_page (page);
+	return false;
+}
+
+/* Returns true if loading non-resident PAGE reads the disk. */
+static bool
+vm_page_reads_disk (struct page *page) {
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			return page->uninit.aux != NULL;
+		case VM_ANON:
+			return page->anon.swap_slot != SWAP_SLOT_NONE;
+		case VM_SHM:
+			return shm_page_swapped (page);
+		default:
+			return true;
+	}
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct thread *curr = thread_current ();
+	struct supplemental_page_table *spt = &vm_space_owner ()->spt;
 	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+	bool success = false;
+	bool major = false;
+
+	if (addr == NULL || is_kernel_vaddr (addr))
+		return false;
+
+	lock_acquire (&frame_lock);
+	page = spt_find_page (spt, addr);
+	while (page != NULL && page->frame != NULL && page->frame->writeback) {
+		cond_wait (&writeback_cond, &frame_lock);
+		page = spt_find_page (spt, addr);
+	}
+	if (page == NULL) {
+		/* A fault inside a system call sees the kernel stack pointer, so use
+		 * the one saved on the way into the kernel. */
+		void *rsp = user ? (void *) f->rsp : curr->user_rsp;
+		if (vm_is_stack_access (addr, rsp) && vm_stack_growth (addr)) {
+			curr->vmstat.stack_faults++;
+			success = true;
+		}
+		goto done;
+	}
+	if (write && !page->writable)
+		goto done;
 
-	return vm_do_claim_page (page);
+	/* A write-protected page may have been evicted since the fault. */
+	if (!not_present && page->frame != NULL)
+		success = vm_handle_wp (page);
+	else if (page->frame != NULL)
+		success = vm_map_page (page);
+	else if (!write && vm_is_untouched_anon (page))
+		success = vm_map_zero_page (page);
+	else if (vm_share_page (page))
+		success = true;
+	else {
+		major = vm_page_reads_disk (page);
+		if (vm_lazy_file_arg (page) != NULL
+				&& vm_lazy_file_arg (page)->area != NULL)
+			success = vm_fault_around (page);
+		else if (vm_claim_large (page))
+			success = true;
+		else
+			success = vm_do_claim_page (page);
+	}
+done:
+	if (success && major)
+		curr->vmstat.major_faults++;
+	else if (success)
+		curr->vmstat.minor_faults++;
+	lock_release (&frame_lock);
+	return success;
 }
 
 /* Free the page.
@@ -150,41 +1296,270 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
+vm_claim_page (void *va) {
 	struct page *page = NULL;
-	/* TODO: Fill this function */
+	bool success = false;
 
-	return vm_do_claim_page (page);
+	lock_acquire (&frame_lock);
+	page = spt_find_page (&vm_space_owner ()->spt, va);
+	if (page != NULL)
+		success = vm_do_claim_page (page);
+	lock_release (&frame_lock);
+
+	return success;
 }
 
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame;
+
+	if (page == NULL)
+		return false;
+
+	/* At its limit, a process gives up a page of its own rather than
+	 * taking one from everyone else. */
+	if (page->owner->rss_limit != 0)
+		vm_shrink_resident (page->owner, page->owner->rss_limit - 1);
+
+	frame = vm_get_frame ();
+	if (frame == NULL)
+		return false;
 
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	vm_link_page (page, frame);
+	list_push_back (&frame_table, &frame->elem);
+
+	/* Keep the frame out of the clock while it is being filled. */
+	frame->pinned = true;
+	if (!swap_in (page, frame->kva) || !vm_map_page (page)) {
+		frame->pinned = false;
+		vm_unmap_page (page);
+		return false;
+	}
+	frame->pinned = false;
+	vm_text_insert (page);
+	return true;
+}
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+static uint64_t
+page_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page *page = hash_entry (e, struct page, spt_elem);
+	return hash_bytes (&page->va, sizeof page->va);
+}
 
-	return swap_in (page, frame->kva);
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	const struct page *pa = hash_entry (a, struct page, spt_elem);
+	const struct page *pb = hash_entry (b, struct page, spt_elem);
+	return pa->va < pb->va;
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	hash_init (&spt->pages, page_hash, page_less, NULL);
+	list_init (&spt->resident);
+}
+
+/* Copies the aux of a lazily loaded page of SRC_OWNER. The executable is
+ * reopened by the child, so point the copy at the child's handle. */
+static void *
+copy_lazy_load_arg (struct lazy_load_arg *arg, struct thread *src_owner) {
+	struct lazy_load_arg *copy = malloc (sizeof *copy);
+
+	if (copy != NULL) {
+		*copy = *arg;
+		if (arg->file == src_owner->running_file)
+			copy->file = thread_current ()->running_file;
+		vm_area_get (copy->area);
+	}
+	return copy;
+}
+
+/* Gives the current process a private anonymous copy of file-backed page
+ * SRC. Mappings are not inherited, their contents are. */
+static bool
+copy_file_page (struct page *src) {
+	struct page *dst;
+	bool success;
+
+	if (src->frame == NULL && !vm_do_claim_page (src))
+		return false;
+	if (!vm_alloc_page (VM_ANON, src->va, src->writable))
+		return false;
+
+	dst = spt_find_page (&thread_current ()->spt, src->va);
+	src->frame->pinned = true;
+	success = vm_do_claim_page (dst);
+	src->frame->pinned = false;
+	if (success)
+		memcpy (dst->frame->kva, src->frame->kva, PGSIZE);
+	return success;
+}
+
+/* Shares resident or swapped page SRC with the current process: anonymous
+ * pages copy-on-write, executable text read-only. The copy is mapped by
+ * vm_fork_page_tables (), or else by its first fault. */
+static bool
+copy_shared_page (struct page *src) {
+	struct page *dst = malloc (sizeof *dst);
+
+	if (dst == NULL)
+		return false;
+
+	memcpy (dst, src, sizeof *dst);
+	dst->owner = thread_current ();
+	dst->frame = NULL;
+	dst->area = NULL;
+	dst->prefetched = false;
+	if (page_get_type (src) == VM_FILE)
+		dst->file.file = dst->owner->running_file;
+	if (!spt_insert_page (&dst->owner->spt, dst)) {
+		free (dst);
+		return false;
+	}
+
+	if (src->frame == NULL) {
+		if (page_get_type (src) == VM_ANON)
+			anon_share_swap (dst, src);
+		return true;
+	}
+
+	vm_link_page (dst, src->frame);
+	return vm_map_page (src);
 }
 
 /* Copy supplemental page table from src to dst */
 bool
 supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+	struct text_key key;
+	bool success = true;
+
+	lock_acquire (&frame_lock);
+	hash_first (&i, &src->pages);
+	while (success && hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page, spt_elem);
+
+		switch (VM_TYPE (page->operations->type)) {
+			case VM_UNINIT:
+				if (VM_TYPE (page->uninit.type) == VM_FILE
+						&& !vm_text_key (page, &key)) {
+					success = copy_file_page (page);
+				} else {
+					void *aux = page->uninit.aux;
+					if (aux != NULL) {
+						aux = copy_lazy_load_arg (aux, page->owner);
+						if (aux == NULL) {
+							success = false;
+							break;
+						}
+					}
+					success = vm_alloc_page_with_initializer (page->uninit.type,
+							page->va, page->writable, page->uninit.init, aux);
+					if (!success)
+						free (aux);
+				}
+				break;
+			case VM_ANON:
+				success = copy_shared_page (page);
+				break;
+			case VM_FILE:
+				if (vm_text_key (page, &key))
+					success = copy_shared_page (page);
+				else
+					success = copy_file_page (page);
+				break;
+			case VM_SHM:
+				/* Attached again by shm_fork (). */
+				break;
+			default:
+				success = false;
+				break;
+		}
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Returns true if every page the page table PDE maps at VA is mapped
+ * read-only, to the frame of the current process's page at the same
+ * address. Only such a table may be shared with the current process. A
+ * private copy the child made may have been evicted already, leaving the
+ * child's table empty next to a writable page of the parent. */
+static bool
+page_table_matches (uint64_t *pde, void *va) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint64_t *pt;
+
+	if (*pde & PTE_PS)
+		return false;
+	pt = ptov (PTE_ADDR (*pde));
+	for (size_t i = 0; i < PGSIZE / sizeof *pt; i++) {
+		struct page *page;
+
+		if (!(pt[i] & PTE_P))
+			continue;
+		if (pt[i] & PTE_W)
+			return false;
+		page = spt_find_page (spt, (uint8_t *) va + i * PGSIZE);
+		if (page == NULL || page->frame == NULL
+				|| vtop (page->frame->kva) != PTE_ADDR (pt[i]))
+			return false;
+	}
+	return true;
+}
+
+/* Shares the page table PDE of PARENT, mapping the LARGE_PGSIZE bytes at
+ * VA, with the current process if that maps the same frames for both.
+ * Otherwise the pages of the current process are mapped one by one by
+ * their first faults. */
+static bool
+share_page_table (uint64_t *pde, void *va, void *parent) {
+	/* Segments are attached again without their frames. */
+	if (!shm_overlaps (parent, va, LARGE_PGSIZE)
+			&& page_table_matches (pde, va))
+		pml4_share_table (thread_current ()->pml4, pde, va);
+	return true;
+}
+
+/* Maps the pages the current process shares with PARENT after
+ * supplemental_page_table_copy () by sharing the page tables of PARENT.
+ * The pages of a table that cannot be shared are mapped by their first
+ * fault instead. */
+void
+vm_fork_page_tables (struct thread *parent) {
+	lock_acquire (&frame_lock);
+	pml4_for_each_table (parent->pml4, share_page_table, parent);
+	lock_release (&frame_lock);
+}
+
+static void
+spt_destroy_page (struct hash_elem *e, void *aux UNUSED) {
+	vm_dealloc_page (hash_entry (e, struct page, spt_elem));
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	struct thread *curr = thread_current ();
+
+	/* Unmapping writes the mapped files back. */
+	while (!list_empty (&curr->mmap_list)) {
+		struct mmap_file *mmap = list_entry (list_front (&curr->mmap_list),
+				struct mmap_file, elem);
+		do_munmap (mmap->addr);
+	}
+	shm_detach_all ();
+
+	lock_acquire (&frame_lock);
+	/* Let go of shared page tables rather than copying them to clear the
+	 * pages one by one. */
+	if (curr->pml4 != NULL)
+		pml4_drop_shared (curr->pml4);
+	hash_clear (&spt->pages, spt_destroy_page);
+	lock_release (&frame_lock);
 }